@@ -1,84 +1,410 @@
 #include "MSQLite3.h"
+#include "MSQLite3Vfs.h"
 #include <stdexcept>
+#include <iterator>
+#include <random>
+
+namespace {
+
+//Count of virtual machine instructions between checks of deadline and token
+const int progressInterval = 1000;
+
+//Holds mutex of connection, it is null and nothing is locked unless SQLite is serialized
+class ConnectionLock
+{
+private:
+	sqlite3_mutex* mutex;
+public:
+	explicit ConnectionLock(sqlite3* db)
+		:mutex(sqlite3_db_mutex(db))
+	{
+		sqlite3_mutex_enter(mutex);
+	}
+
+	~ConnectionLock()
+	{
+		sqlite3_mutex_leave(mutex);
+	}
+
+	ConnectionLock(const ConnectionLock&) = delete;
+	ConnectionLock& operator=(const ConnectionLock&) = delete;
+};
+
+//Watches one execution, installs progress handler only if there is something to watch
+//Executions nested on one connection, e.g. query run from forEachRow callback, chain their guards, so deadline and
+//token of outer execution are checked also during inner one and handler of outer one is restored when inner one ends
+class ExecutionGuard
+{
+private:
+	sqlite3* db;
+	ConnectionCounters* counters;
+	std::chrono::milliseconds timeout;
+	std::chrono::steady_clock::time_point deadline;
+	const CancellationToken* token;
+	ExecutionGuard* outer;
+	ExecutionGuard* inner;
+	//Timeout which stopped execution, own or of outer execution
+	std::chrono::milliseconds expired;
+	bool timedOut;
+	bool active;
+
+	static int onProgress(void* data)
+	{
+		ExecutionGuard* guard = static_cast<ExecutionGuard*>(data);
+		const auto now = std::chrono::steady_clock::now();
+		for (const ExecutionGuard* watched = guard; watched; watched = watched->outer) {
+			if (watched->token && watched->token->isCancelled())
+				return 1;
+			if (watched->timeout.count() > 0 && now >= watched->deadline) {
+				guard->timedOut = true;
+				guard->expired = watched->timeout;
+				return 1;
+			}
+		}
+		const ConnectionCounters* counters = guard->counters;
+		return counters->progressCallback ? counters->progressCallback(counters->progressData) : 0;
+	}
+public:
+	//Installs handler of innermost guard or handler set by SQLite3::setProgressHandler if there is none
+	//Has to be called under mutex of connection
+	static void install(sqlite3* db, const ConnectionCounters* counters)
+	{
+		void* guard = counters->executionGuard.load();
+		if (!guard) {
+			sqlite3_progress_handler(db, counters->progressInstructions, counters->progressCallback, counters->progressData);
+			return;
+		}
+		int instructions = progressInterval;
+		if (counters->progressCallback)
+			instructions = std::min(instructions, counters->progressInstructions);
+		sqlite3_progress_handler(db, instructions, onProgress, guard);
+	}
+
+	//[start] is start of execution which continues from previous calls, deadline is counted from it
+	ExecutionGuard(sqlite3* db, ConnectionCounters* counters, std::chrono::milliseconds timeout, const CancellationToken* token
+		, std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now())
+		:
+		db(db),
+		counters(counters),
+		timeout(timeout),
+		deadline(start + timeout),
+		token(token),
+		outer(nullptr),
+		inner(nullptr),
+		expired(timeout),
+		timedOut(false),
+		active(timeout.count() > 0 || token)
+	{
+		ConnectionLock lock(db);
+		outer = static_cast<ExecutionGuard*>(counters->executionGuard.load());
+		//Execution nested in watched one can be stopped by outer deadline or token, so it has to be watched too
+		active = active || outer;
+		if (!active)
+			return;
+		if (outer)
+			outer->inner = this;
+		counters->executionGuard = this;
+		install(db, counters);
+	}
+
+	~ExecutionGuard()
+	{
+		if (!active)
+			return;
+		ConnectionLock lock(db);
+		//Guards of executions shared by threads do not have to end in reverse order
+		if (outer)
+			outer->inner = inner;
+		if (inner)
+			inner->outer = outer;
+		else
+			counters->executionGuard = outer;
+		install(db, counters);
+	}
+
+	ExecutionGuard(const ExecutionGuard&) = delete;
+	ExecutionGuard& operator=(const ExecutionGuard&) = delete;
+
+	bool hasTimedOut() const
+	{
+		return timedOut;
+	}
+
+	//Timeout which stopped execution, valid if hasTimedOut returned true
+	std::chrono::milliseconds expiredTimeout() const
+	{
+		return expired;
+	}
+
+	//Returns true if token was cancelled before execution started
+	bool cancelled() const
+	{
+		return token && token->isCancelled();
+	}
+
+	//Returns true and counts it if execution was interrupted by timeout, token or SQLite3::interrupt
+	bool interrupted(int rc, ConnectionCounters* counters) const
+	{
+		if (rc != SQLITE_INTERRUPT)
+			return false;
+		++(timedOut ? counters->timeouts : counters->cancellations);
+		return true;
+	}
+
+	//Describes interruption, valid if interrupted returned true
+	SQLite3ErrorInfo interruption() const
+	{
+		return timedOut ? QueryTimeout::describe(expired) : QueryCancelled::describe();
+	}
+
+	//Throws QueryTimeout or QueryCancelled if execution was interrupted
+	void check(int rc, ConnectionCounters* counters) const
+	{
+		if (interrupted(rc, counters))
+			throwError(interruption());
+	}
+};
+
+void appendRow(sqlite3_stmt* stmt, void* data)
+{
+	static_cast<ResultSet*>(data)->addRecord(stmt);
+}
+
+int ignoreRows(void*, int, char**, char**)
+{
+	return 0;
+}
+
+int collectRows(void* data, int count, char** row, char** columns)
+{
+	ResultSet* rs = (ResultSet*)data;
+	rs->addRecord(count, (const char**)row, (const char**)columns);
+	return 0;
+}
+
+}
+
+//------------------------ConnectionCounters-----------------------------//
+
+namespace {
+
+void add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+	if (value)
+		counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+}
+
+void ConnectionCounters::add(const StatementStats& execution) noexcept
+{
+	::add(executions, execution.executions);
+	::add(failures, execution.failures);
+	::add(rows, execution.rows);
+	::add(vmSteps, execution.vmSteps);
+	::add(fullScanSteps, execution.fullScanSteps);
+	::add(sorts, execution.sorts);
+	::add(autoIndexes, execution.autoIndexes);
+	::add(reprepares, execution.reprepares);
+	::add(timeNs, execution.time.count());
+	::add(timedExecutions, execution.timedExecutions);
+}
+
+void ConnectionCounters::error(int rc) noexcept
+{
+	const int code = rc & 0xff;
+	if (code < SQLite3Metrics::errorCodes)
+		::add(errors[code], 1);
+	if (code == SQLITE_BUSY || code == SQLITE_LOCKED)
+		::add(busy, 1);
+}
+
+StatementStats ConnectionCounters::statements() const
+{
+	StatementStats rval;
+	rval.executions = executions;
+	rval.failures = failures;
+	rval.rows = rows;
+	rval.vmSteps = vmSteps;
+	rval.fullScanSteps = fullScanSteps;
+	rval.sorts = sorts;
+	rval.autoIndexes = autoIndexes;
+	rval.reprepares = reprepares;
+	rval.time = std::chrono::nanoseconds(timeNs);
+	rval.timedExecutions = timedExecutions;
+	return rval;
+}
 
 //------------------------ResultSet-----------------------------//
 
-ResultSet::ResultSet()
+ResultSchema::ResultSchema(std::vector<ResultColumn> columns)
+	:list(std::move(columns))
 {
-	iterator = container.begin();
+	for (int i = 0; i < static_cast<int>(list.size()); ++i)
+		index.insert({ list[i].name, i });
 }
 
-ResultSet::ResultSet(sqlite3_stmt * stmt)
-	:ResultSet()
+std::shared_ptr<const ResultSchema> ResultSchema::fromStatement(sqlite3_stmt* stmt, bool withConstraints)
 {
-	while (sqlite3_step(stmt) == SQLITE_ROW) // While query has result-rows.
-	{
-		//  Iterate all columns and push column - name value pair to record
-		Container::value_type record;
-		for (int colIndex = 0; colIndex < sqlite3_column_count(stmt); ++colIndex)
-		{
-			const char * valuePtr = (const char*)(sqlite3_column_text(stmt, colIndex));
-			record.insert({ sqlite3_column_name(stmt, colIndex),valuePtr ? valuePtr : "" });
+	auto text = [](const char* value) { return std::string(value ? value : ""); };
+	std::vector<ResultColumn> columns(sqlite3_column_count(stmt));
+	for (int i = 0; i < static_cast<int>(columns.size()); ++i) {
+		columns[i].name = text(sqlite3_column_name(stmt, i));
+		columns[i].declaredType = text(sqlite3_column_decltype(stmt, i));
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+		columns[i].database = text(sqlite3_column_database_name(stmt, i));
+		columns[i].table = text(sqlite3_column_table_name(stmt, i));
+		columns[i].origin = text(sqlite3_column_origin_name(stmt, i));
+#endif
+		if (!withConstraints || columns[i].origin.empty())
+			continue;
+
+		const char* collation = nullptr;
+		int notNull = 0, primaryKey = 0, autoIncrement = 0;
+		if (sqlite3_table_column_metadata(sqlite3_db_handle(stmt), columns[i].database.c_str(), columns[i].table.c_str(), columns[i].origin.c_str()
+			, nullptr, &collation, &notNull, &primaryKey, &autoIncrement) == SQLITE_OK) {
+			columns[i].collation = text(collation);
+			columns[i].notNull = notNull != 0;
+			columns[i].primaryKey = primaryKey != 0;
+			columns[i].autoIncrement = autoIncrement != 0;
 		}
+	}
+	return std::make_shared<const ResultSchema>(std::move(columns));
+}
+
+const std::shared_ptr<const ResultSchema>& ResultSchema::empty()
+{
+	static const std::shared_ptr<const ResultSchema> rval = std::make_shared<const ResultSchema>();
+	return rval;
+}
 
-		addRecord(std::move(record));
+ResultRow::ResultRow(Values&& record)
+{
+	std::vector<ResultColumn> columns;
+	for (auto& value : record) {
+		ResultColumn column;
+		column.name = value.first;
+		columns.push_back(std::move(column));
+		values.push_back(std::move(value.second));
 	}
+	schema = std::make_shared<const ResultSchema>(std::move(columns));
+}
+
+ResultRow::ResultRow(std::shared_ptr<const ResultSchema> schema, sqlite3_stmt* stmt)
+	:schema(std::move(schema))
+{
+	const int count = sqlite3_column_count(stmt);
+	values.reserve(count);
+	for (int colIndex = 0; colIndex < count; ++colIndex)
+	{
+		const char * valuePtr = (const char*)(sqlite3_column_text(stmt, colIndex));
+		values.emplace_back(valuePtr ? valuePtr : "", valuePtr ? sqlite3_column_bytes(stmt, colIndex) : 0);
+	}
+}
+
+ResultSet::ResultSet()
+	:schema(ResultSchema::empty())
+	,cursor(0)
+{
+}
+
+ResultSet::ResultSet(std::shared_ptr<const ResultSchema> schema)
+	:schema(std::move(schema))
+	,cursor(0)
+{
+}
+
+ResultSet::ResultSet(sqlite3_stmt * stmt, int* rc)
+	:ResultSet(ResultSchema::fromStatement(stmt))
+{
+	int stepRc;
+	while ((stepRc = sqlite3_step(stmt)) == SQLITE_ROW) // While query has result-rows.
+		addRecord(stmt);
+	if (rc)
+		*rc = stepRc;
 }
 
 void ResultSet::addRecord(int count, const char** row, const char** cols)
 {
 	if (count)
 	{
-		Container::value_type icontain;
+		//sqlite3_exec passes the same names for every row of statement, new schema is made when they change
+		bool same = static_cast<int>(schema->size()) == count;
+		for (int i = 0; same && i < count; i++)
+			same = (*schema)[i].name == cols[i];
+		if (!same) {
+			std::vector<ResultColumn> columns(count);
+			for (int i = 0; i < count; i++)
+				columns[i].name = cols[i];
+			schema = std::make_shared<const ResultSchema>(std::move(columns));
+		}
+
+		std::vector<std::string> values;
+		values.reserve(count);
 		for (int i = 0; i < count; i++)
-			icontain.insert({ cols[i],(row && row[i] ? row[i] : "") });
-		addRecord(std::move(icontain));
+			values.emplace_back(row && row[i] ? row[i] : "");
+		addRecord(ResultRow(schema, std::move(values)));
 	}
 }
 
-void ResultSet::addRecord(Container::value_type&& record)
+void ResultSet::addRecord(sqlite3_stmt* stmt)
 {
-	container.emplace_back(std::move(record));
-	iterator = container.begin();
+	if (static_cast<int>(schema->size()) != sqlite3_column_count(stmt))
+		schema = ResultSchema::fromStatement(stmt);
+	addRecord(ResultRow(schema, stmt));
 }
 
-ResultSet::operator bool()
+void ResultSet::addRecord(ResultRow&& record)
 {
-	return container.size() > 0 && iterator != container.end();
+	container.emplace_back(std::move(record));
+	cursor = 0;
 }
 
-bool ResultSet::next()
+void ResultSet::merge(ResultSet&& other)
 {
-	if (iterator != container.end())
-		iterator = std::next(iterator, 1);
-	return iterator != container.end();
+	container.reserve(container.size() + other.container.size());
+	std::move(other.container.begin(), other.container.end(), std::back_inserter(container));
+	other.container.clear();
+	other.cursor = 0;
+	if (schema->size() == 0)
+		schema = other.schema;
+	cursor = 0;
 }
 
-size_t ResultSet::count()
+const ResultSchema& ResultSet::columns() const
 {
-	return container.size();
+	if (schema->size() == 0 && !container.empty())
+		return container.front().columns();
+	return *schema;
 }
 
 //------------------------SQLite3-----------------------------//
 
-SQLite3::SQLite3(const char* dbPath, const char* createStmt)
+SQLite3::SQLite3(const char* dbPath, const char* createStmt, const char* vfs)
 	:
 	errMsg(nullptr),
-	db(nullptr)
+	db(nullptr),
+	timeoutMs(0)
 {
-	result = sqlite3_open(dbPath, &db);
+	result = sqlite3_open_v2(dbPath, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
 	isOpened = result == SQLITE_OK;
 
 	//If statement to create database was provided
-	if (createStmt)
-		result = sqlite3_exec(db, createStmt, [](void* data, int count, char** row, char** columns)->int { return 0; }, 0, &errMsg);
+	if (createStmt && isOpened)
+		result = sqlite3_exec(db, createStmt, ignoreRows, 0, &errMsg);
 
 	if (result != SQLITE_OK)
-		throw SQLite3Error(std::string("Database can't be initialized: \nResult: ") + std::to_string(result) + "\t" + errMsg);
+	{
+		SQLite3ErrorInfo error = SQLite3ErrorInfo::fromDb(db, createStmt);
+		error.message = "Database can't be initialized: \nResult: " + std::to_string(result) + "\t" + error.message;
+		throw SQLite3Error(std::move(error));
+	}
 }
 
 SQLite3::~SQLite3()
 {
+	//Unfinalized statements would keep connection open
+	statementCache.clear();
 	if (errMsg != nullptr)
 		sqlite3_free(errMsg);
 	if (isOpened)
@@ -105,51 +431,201 @@ sqlite_int64 SQLite3::lastId() const
 	return isPrepared() ? sqlite3_last_insert_rowid(db) : -1;
 }
 
-void SQLite3::execute(const char* sql)
+int SQLite3::changes() const
+{
+	return isPrepared() ? sqlite3_changes(db) : 0;
+}
+
+sqlite3* SQLite3::handle() const
+{
+	return db;
+}
+
+SQLite3Metrics SQLite3::metrics() const
+{
+	SQLite3Metrics rval;
+	InstrumentedVfs::collect(rval);
+	rval.timeouts = counters.timeouts;
+	rval.cancellations = counters.cancellations;
+	rval.statements = counters.statements();
+	rval.rawQueries = counters.rawQueries;
+	for (int code = 0; code < SQLite3Metrics::errorCodes; ++code)
+		rval.errors[code] = counters.errors[code];
+	rval.busy = counters.busy;
+	rval.transactionRetries = counters.transactionRetries;
+	rval.failedCommits = counters.failedCommits;
+	rval.statementCacheHits = counters.statementCacheHits;
+	rval.statementCacheMisses = counters.statementCacheMisses;
+	if (!isOpened) {
+		rval.pageCacheHits = counters.pageCacheHits.total;
+		rval.pageCacheMisses = counters.pageCacheMisses.total;
+		rval.pageCacheWrites = counters.pageCacheWrites.total;
+		return rval;
+	}
+
+	//Statement can run on other thread, sqlite3_db_status locks connection itself but file of journal does not
+	ConnectionLock lock(db);
+	//Only increase since last call is added, difference of 31 bit values survives their wrap
+	auto take = [this](ConnectionCounters::PageCacheCounter& counter, int op) {
+		int current = 0, highwater = 0;
+		if (sqlite3_db_status(db, op, &current, &highwater, 0) == SQLITE_OK) {
+			const uint32_t previous = counter.seen.exchange(static_cast<uint32_t>(current), std::memory_order_relaxed);
+			::add(counter.total, (static_cast<uint32_t>(current) - previous) & 0x7fffffff);
+		}
+		return counter.total.load(std::memory_order_relaxed);
+	};
+	rval.pageCacheHits = take(counters.pageCacheHits, SQLITE_DBSTATUS_CACHE_HIT);
+	rval.pageCacheMisses = take(counters.pageCacheMisses, SQLITE_DBSTATUS_CACHE_MISS);
+	rval.pageCacheWrites = take(counters.pageCacheWrites, SQLITE_DBSTATUS_CACHE_WRITE);
+
+	int current = 0, highwater = 0;
+	sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0);
+	rval.pageCacheBytes = current;
+
+	//Pager returns WAL file in WAL mode and rollback journal otherwise, file is asked through its VFS
+	sqlite3_file* journal = nullptr;
+	sqlite3_int64 size = 0;
+	if (sqlite3_file_control(db, "main", SQLITE_FCNTL_JOURNAL_POINTER, &journal) == SQLITE_OK
+		&& journal && journal->pMethods && journal->pMethods->xFileSize(journal, &size) == SQLITE_OK)
+		rval.walBytes = size;
+	return rval;
+}
+
+void SQLite3::setTimeout(std::chrono::milliseconds timeout)
+{
+	timeoutMs = timeout;
+}
+
+void SQLite3::setTiming(bool enabled)
+{
+	counters.timing = enabled;
+}
+
+void SQLite3::setProgressHandler(int instructions, int (*callback)(void*), void* data)
+{
+	if (instructions < 1 || !callback) {
+		instructions = 0;
+		callback = nullptr;
+		data = nullptr;
+	}
+	if (!isOpened)
+		return;
+	ConnectionLock lock(db);
+	counters.progressInstructions = instructions;
+	counters.progressCallback = callback;
+	counters.progressData = data;
+	ExecutionGuard::install(db, &counters);
+}
+
+void SQLite3::interrupt()
+{
+	if (isOpened)
+		sqlite3_interrupt(db);
+}
+
+bool SQLite3::run(const char* sql, int (*callback)(void*, int, char**, char**), void* data, SQLite3ErrorInfo& error)
 {
-	if (sql)
+	if (!sql)
 	{
-		result = sqlite3_exec(db, sql, [](void* data, int count, char** row, char** columns)->int {return 0; }, 0, &errMsg);
-		if (result != SQLITE_OK)
-			throw SQLite3Error(errMsg);
+		error = SQLite3ErrorInfo::fromCode(SQLITE_MISUSE, "No sql parameter");
+		return false;
 	}
-	else
-		throw SQLite3Error("No sql parameter");
+
+	//Message of previous failure is kept until next call for error()
+	if (errMsg)
+	{
+		sqlite3_free(errMsg);
+		errMsg = nullptr;
+	}
+
+	ExecutionGuard guard(db, &counters, timeoutMs, nullptr);
+	result = sqlite3_exec(db, sql, callback, data, &errMsg);
+	::add(counters.rawQueries, 1);
+	if (result == SQLITE_OK)
+		return true;
+
+	counters.error(result);
+	error = guard.interrupted(result, &counters) ? guard.interruption() : SQLite3ErrorInfo::fromDb(db, sql);
+	return false;
+}
+
+void SQLite3::execute(const char* sql)
+{
+	SQLite3ErrorInfo error;
+	if (!run(sql, ignoreRows, nullptr, error))
+		throwError(std::move(error));
 }
 
 ResultSet SQLite3::executeQuery(const char* sql)
 {
-	if (sql)
-	{
-		ResultSet retval;
-		result = sqlite3_exec(db, sql, [](void* data, int count, char** row, char** columns)->int
-			{
-				ResultSet* rs = (ResultSet*)data;
-				rs->addRecord(count, (const char**)row, (const char**)columns);
-				return 0;
-			}, &retval, &errMsg);
-		if (result != SQLITE_OK)
-			throw SQLite3Error(errMsg);
-		return retval;
+	ResultSet retval;
+	SQLite3ErrorInfo error;
+	if (!run(sql, collectRows, &retval, error))
+		throwError(std::move(error));
+	return retval;
+}
+
+Expected<void> SQLite3::tryExecute(const char* sql)
+{
+	SQLite3ErrorInfo error;
+	if (!run(sql, ignoreRows, nullptr, error))
+		return error;
+	return Expected<void>();
+}
+
+Expected<ResultSet> SQLite3::tryExecuteQuery(const char* sql)
+{
+	ResultSet retval;
+	SQLite3ErrorInfo error;
+	if (!run(sql, collectRows, &retval, error))
+		return Expected<ResultSet>(std::move(error));
+	return Expected<ResultSet>(std::move(retval));
+}
+
+Expected<PreparedStatement> SQLite3::tryPrepare(const std::string& query)
+{
+	PreparedStatement ps(db, &counters, timeoutMs, query, std::nothrow);
+	if (ps.rc != SQLITE_OK)
+		return SQLite3ErrorInfo::fromDb(db, query.c_str());
+	return Expected<PreparedStatement>(std::move(ps));
+}
+
+PreparedStatement& SQLite3::cachedStatement(const std::string& query)
+{
+	auto it = statementCache.find(query);
+	if (it == statementCache.end()) {
+		::add(counters.statementCacheMisses, 1);
+		it = statementCache.emplace(query, createPreparedStatement(query)).first;
 	}
-	else
-		throw SQLite3Error("No sql parameter");
+	else {
+		::add(counters.statementCacheHits, 1);
+		it->second.reset();
+	}
+	return it->second;
 }
 
 void SQLite3::beginTransaction()
 {
-	result = sqlite3_exec(db, "BEGIN TRANSACTION", 0, 0, &errMsg);
+	execute("BEGIN TRANSACTION");
+}
 
-	if (result != SQLITE_OK)
-		throw SQLite3Error(errMsg);
+void SQLite3::beginWriteTransaction()
+{
+#ifdef MSQLITE3_BEGIN_CONCURRENT
+	execute("BEGIN CONCURRENT");
+#else
+	execute("BEGIN IMMEDIATE");
+#endif
 }
 
 void SQLite3::endTransaction()
 {
-	result = sqlite3_exec(db, "END TRANSACTION", 0, 0, &errMsg); 
-	
-	if (result != SQLITE_OK)
-		throw SQLite3Error(errMsg);
+	execute("END TRANSACTION");
+}
+
+bool SQLite3::inTransaction() const
+{
+	return isPrepared() && sqlite3_get_autocommit(db) == 0;
 }
 
 std::string SQLite3::toString(const std::tm& date)
@@ -159,6 +635,22 @@ std::string SQLite3::toString(const std::tm& date)
 	return ss.str();
 }
 
+void SQLite3::backoff(int attempt)
+{
+	//Delay of n-th attempt is random between half and full of 2^(n-1) ms, limited to 100 ms
+	thread_local std::minstd_rand random(std::random_device{}());
+	const int limit = std::min(100, 1 << std::min(attempt - 1, 7)) * 1000;
+	std::this_thread::sleep_for(std::chrono::microseconds(std::uniform_int_distribution<int>(limit / 2, limit)(random)));
+}
+
+std::string SQLite3::quote(const std::string& identifier)
+{
+	std::string rval = "\"";
+	for (char c : identifier)
+		rval += c == '"' ? std::string("\"\"") : std::string(1, c);
+	return rval + "\"";
+}
+
 std::string SQLite3::toStringM(const std::tm& date)
 {
 	std::stringstream ss("");
@@ -166,31 +658,208 @@ std::string SQLite3::toStringM(const std::tm& date)
 	return ss.str();
 }
 
-PreparedStatement& PreparedStatement::reset()
+PreparedStatement::PreparedStatement(sqlite3* db, ConnectionCounters* counters, std::chrono::milliseconds timeout, const std::string& query, std::nothrow_t)
+	:
+	rc(SQLITE_OK)
+	,db(db)
+	,stmt(nullptr)
+	,paramCount(std::count(query.begin(), query.end(), '?'))
+	,counters(counters)
+	,timeoutMs(timeout)
+	,hasToken(false)
+	,failure(Failure::None)
+	,expiredMs(0)
+	,constrained(false)
+	,timed(counters->timing)
+	,stepping(false)
+	,steppedRows(0)
 {
-	rc = sqlite3_clear_bindings(stmt);
-	rc = sqlite3_reset(stmt);
-	return *this;
+	rc = sqlite3_prepare_v3(db, query.c_str(), query.length(), 0, &stmt, 0);
+	if (rc != SQLITE_OK)
+		counters->error(rc);
 }
 
-PreparedStatement& PreparedStatement::execute()
+const std::shared_ptr<const ResultSchema>& PreparedStatement::describe() const
 {
-	do {
-		rc = sqlite3_step(stmt);
-	} while (rc == SQLITE_ROW);
+	if (!schema)
+		schema = stmt ? ResultSchema::fromStatement(stmt) : ResultSchema::empty();
+	return schema;
+}
+
+const ResultSchema& PreparedStatement::columns() const
+{
+	if (!constrained && stmt) {
+		schema = ResultSchema::fromStatement(stmt, true);
+		constrained = true;
+	}
+	return *describe();
+}
 
+void PreparedStatement::record(uint64_t rows, std::chrono::steady_clock::time_point start) noexcept
+{
+	StatementStats execution;
+	execution.executions = 1;
+	execution.failures = rc != SQLITE_DONE;
+	execution.rows = rows;
+	if (timed) {
+		execution.time = std::chrono::steady_clock::now() - start;
+		execution.timedExecutions = 1;
+	}
+	//Counters of SQLite are reset, so they hold only steps of next execution
+	if (stmt) {
+		execution.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+		execution.fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+		execution.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+		execution.autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+		execution.reprepares = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_REPREPARE, 1);
+	}
+	statistics += execution;
+	counters->add(execution);
 	if (rc != SQLITE_DONE)
-		throw SQLite3Error(sqlite3_errmsg(db));
+		counters->error(rc);
+}
 
-	return *this;
+int PreparedStatement::failed() noexcept
+{
+	//Only SQLite3::interrupt can stop execution which has no progress handler
+	if (rc == SQLITE_INTERRUPT) {
+		++counters->cancellations;
+		failure = Failure::Cancel;
+	}
+	else
+		failure = Failure::Database;
+	return rc;
+}
+
+int PreparedStatement::run(ResultSet* rows)
+{
+	if (!rows)
+		return run(nullptr, nullptr);
+	*rows = ResultSet(describe());
+	return run(appendRow, rows);
+}
+
+int PreparedStatement::run(RowCallback onRow, void* data)
+{
+	ExecutionGuard guard(db, counters, timeoutMs, hasToken ? &token : nullptr);
+	const auto start = started();
+	uint64_t rows = 0;
+	if (guard.cancelled())
+		rc = SQLITE_INTERRUPT;
+	else for (; (rc = sqlite3_step(stmt)) == SQLITE_ROW; ++rows) {
+		if (onRow)
+			onRow(stmt, data);
+	}
+	record(rows, start);
+
+	if (rc == SQLITE_DONE) {
+		failure = Failure::None;
+		return SQLITE_OK;
+	}
+	if (guard.interrupted(rc, counters)) {
+		failure = guard.hasTimedOut() ? Failure::Timeout : Failure::Cancel;
+		expiredMs = guard.expiredTimeout();
+	}
+	else
+		failure = Failure::Database;
+	return rc;
+}
+
+int PreparedStatement::step(size_t maxRows, RowCallback onRow, void* data)
+{
+	if (!stepping) {
+		stepping = true;
+		steppedRows = 0;
+		steppingStart = std::chrono::steady_clock::now();
+	}
+
+	ExecutionGuard guard(db, counters, timeoutMs, hasToken ? &token : nullptr, steppingStart);
+	size_t rows = 0;
+	if (guard.cancelled())
+		rc = SQLITE_INTERRUPT;
+	else while (rows < maxRows && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		onRow(stmt, data);
+		++rows;
+	}
+	steppedRows += rows;
+	if (rc == SQLITE_ROW)
+		return SQLITE_ROW;
+
+	stepping = false;
+	record(steppedRows, steppingStart);
+	if (rc == SQLITE_DONE) {
+		failure = Failure::None;
+		return SQLITE_OK;
+	}
+	if (guard.interrupted(rc, counters)) {
+		failure = guard.hasTimedOut() ? Failure::Timeout : Failure::Cancel;
+		expiredMs = guard.expiredTimeout();
+	}
+	else
+		failure = Failure::Database;
+	return rc;
 }
 
 ResultSet PreparedStatement::executeQuery()
 {
-	return ResultSet(stmt);
+	ResultSet rval;
+	if (run(&rval) != SQLITE_OK)
+		throwError(lastError());
+	return rval;
+}
+
+Expected<ResultSet> PreparedStatement::tryExecuteQuery()
+{
+	ResultSet rval;
+	if (run(&rval) != SQLITE_OK)
+		return lastError();
+	return Expected<ResultSet>(std::move(rval));
+}
+
+SQLite3ErrorInfo PreparedStatement::lastError() const
+{
+	SQLite3ErrorInfo rval;
+	switch (failure) {
+	case Failure::ArgumentCount:
+		rval = SQLite3ErrorInfo::fromCode(SQLITE_RANGE, "Count of arguments does not equal count of questionmarks");
+		break;
+	case Failure::Timeout:
+		rval = QueryTimeout::describe(expiredMs);
+		break;
+	case Failure::Cancel:
+		rval = QueryCancelled::describe();
+		break;
+	default:
+		return SQLite3ErrorInfo::fromDb(db, stmt ? sqlite3_sql(stmt) : nullptr);
+	}
+	if (stmt)
+		rval.sql = sqlite3_sql(stmt);
+	return rval;
+}
+
+PreparedStatement& PreparedStatement::timeout(std::chrono::milliseconds timeout)
+{
+	timeoutMs = timeout;
+	return *this;
+}
+
+PreparedStatement& PreparedStatement::cancelWith(const CancellationToken& token)
+{
+	this->token = token;
+	hasToken = true;
+	return *this;
+}
+
+PreparedStatement& PreparedStatement::timing(bool enabled)
+{
+	timed = enabled;
+	return *this;
 }
 
 PreparedStatement::PreparedStatement(PreparedStatement&& ps)
+	:
+	db(nullptr),
+	stmt(nullptr)
 {
 	*this = std::move(ps);
 }
@@ -204,6 +873,19 @@ PreparedStatement& PreparedStatement::operator=(PreparedStatement&&ps)
 	this->rc = ps.rc;
 	this->stmt = ps.stmt;
 	this->paramCount = ps.paramCount;
+	this->counters = ps.counters;
+	this->timeoutMs = ps.timeoutMs;
+	this->token = ps.token;
+	this->hasToken = ps.hasToken;
+	this->failure = ps.failure;
+	this->expiredMs = ps.expiredMs;
+	this->schema = std::move(ps.schema);
+	this->constrained = ps.constrained;
+	this->statistics = ps.statistics;
+	this->timed = ps.timed;
+	this->stepping = ps.stepping;
+	this->steppedRows = ps.steppedRows;
+	this->steppingStart = ps.steppingStart;
 	ps.db = nullptr;
 	ps.stmt = nullptr;
 	return *this;
@@ -2,11 +2,26 @@
 #define MSQLite3H
 #include "sqlite3.h"
 #include <ctime>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <variant>
 
 //-------------Forward declarations-------------
 
@@ -35,9 +50,266 @@ class SQLite3;
 //Error class for all SQLite3 Errors
 class SQLite3Error;
 
+//Description of failed SQLite call
+//Carried by SQLite3Error and returned by non-throwing API in Expected
+struct SQLite3ErrorInfo
+{
+	//Primary result code, e.g. SQLITE_BUSY or SQLITE_CONSTRAINT
+	int code = SQLITE_ERROR;
+
+	//Extended result code, e.g. SQLITE_CONSTRAINT_UNIQUE
+	int extendedCode = SQLITE_ERROR;
+
+	std::string message;
+
+	//Sql text which failed, empty if error is not related to sql
+	std::string sql;
+
+	//Byte offset of error in sql text as reported by sqlite3_error_offset, -1 if unknown
+	int offset = -1;
+
+	//Execution was stopped by timeout, code is SQLITE_INTERRUPT
+	bool timedOut = false;
+
+	//Reads error of last failed call on connection
+	static SQLite3ErrorInfo fromDb(sqlite3* db, const char* sql = nullptr)
+	{
+		SQLite3ErrorInfo rval;
+		rval.extendedCode = sqlite3_extended_errcode(db);
+		rval.code = rval.extendedCode & 0xFF;
+		rval.message = sqlite3_errmsg(db);
+		if (sql)
+			rval.sql = sql;
+#if SQLITE_VERSION_NUMBER >= 3038000
+		rval.offset = sqlite3_error_offset(db);
+#endif
+		return rval;
+	}
+
+	//Error detected by wrapper itself or reported by SQLite call which leaves no message on connection
+	//[code] can be extended result code, primary code is taken from its low byte
+	static SQLite3ErrorInfo fromCode(int code, const std::string& message)
+	{
+		SQLite3ErrorInfo rval;
+		rval.code = code & 0xff;
+		rval.extendedCode = code;
+		rval.message = message;
+		return rval;
+	}
+
+	//Returns true if database was locked by other connection and call can be retried
+	bool isBusy() const {
+		return code == SQLITE_BUSY || code == SQLITE_LOCKED;
+	}
+
+	//Returns true if constraint (UNIQUE, NOT NULL, CHECK, FOREIGN KEY...) was violated
+	bool isConstraint() const {
+		return code == SQLITE_CONSTRAINT;
+	}
+};
+
 class SQLite3Error : public std::runtime_error {
+private:
+	SQLite3ErrorInfo details;
 public:
-	using std::runtime_error::runtime_error;
+	//Error detected by wrapper, code is SQLITE_ERROR
+	SQLite3Error(const std::string& message)
+		:std::runtime_error(message)
+		,details(SQLite3ErrorInfo::fromCode(SQLITE_ERROR, message))
+	{}
+
+	SQLite3Error(SQLite3ErrorInfo info)
+		:std::runtime_error(info.message)
+		,details(std::move(info))
+	{}
+
+	//returns whole description of error
+	const SQLite3ErrorInfo& info() const {
+		return details;
+	}
+
+	//returns primary result code, e.g. SQLITE_BUSY
+	int code() const {
+		return details.code;
+	}
+
+	//returns extended result code, e.g. SQLITE_CONSTRAINT_UNIQUE
+	int extendedCode() const {
+		return details.extendedCode;
+	}
+
+	//returns sql which failed or empty string
+	const std::string& sql() const {
+		return details.sql;
+	}
+
+	//returns byte offset of error in sql or -1
+	int offset() const {
+		return details.offset;
+	}
+};
+
+//I/O done on one kind of database file, collected by InstrumentedVfs (see MSQLite3Vfs.h)
+struct IoMetrics
+{
+	uint64_t reads = 0;
+	uint64_t writes = 0;
+	uint64_t syncs = 0;
+	uint64_t bytesRead = 0;
+	uint64_t bytesWritten = 0;
+	std::chrono::nanoseconds readTime{ 0 };
+	std::chrono::nanoseconds writeTime{ 0 };
+	std::chrono::nanoseconds syncTime{ 0 };
+};
+
+//Execution statistics of one statement or of all statements of connection
+//Counters of SQLite are read by sqlite3_stmt_status after every execution,
+//time is measured only when timing is enabled on statement or connection
+struct StatementStats
+{
+	//Finished executions, including failed ones
+	uint64_t executions = 0;
+	uint64_t failures = 0;
+	//Rows returned by executions
+	uint64_t rows = 0;
+	//Operations of virtual machine
+	uint64_t vmSteps = 0;
+	//Steps of full table scans, sorts and automatic indexes, usually signs of missing index
+	uint64_t fullScanSteps = 0;
+	uint64_t sorts = 0;
+	uint64_t autoIndexes = 0;
+	//Recompilations of statement after schema changed
+	uint64_t reprepares = 0;
+	//Total time of executions run with timing and their count
+	std::chrono::nanoseconds time{ 0 };
+	uint64_t timedExecutions = 0;
+
+	//Returns average time of execution run with timing, zero if there was none
+	std::chrono::nanoseconds averageTime() const {
+		return timedExecutions ? time / static_cast<int64_t>(timedExecutions) : std::chrono::nanoseconds(0);
+	}
+
+	StatementStats& operator+=(const StatementStats& other) {
+		executions += other.executions;
+		failures += other.failures;
+		rows += other.rows;
+		vmSteps += other.vmSteps;
+		fullScanSteps += other.fullScanSteps;
+		sorts += other.sorts;
+		autoIndexes += other.autoIndexes;
+		reprepares += other.reprepares;
+		time += other.time;
+		timedExecutions += other.timedExecutions;
+		return *this;
+	}
+};
+
+//Snapshot of wrapper metrics returned by SQLite3::metrics()
+struct SQLite3Metrics
+{
+	//I/O counters are process wide and stay zero unless InstrumentedVfs is installed
+	IoMetrics mainDb;
+	IoMetrics wal;
+	IoMetrics journal;
+	//Temporary databases, statement journals and super-journals
+	IoMetrics otherFiles;
+
+	//Executions stopped because their deadline passed
+	uint64_t timeouts = 0;
+	//Executions stopped by CancellationToken or SQLite3::interrupt
+	uint64_t cancellations = 0;
+
+	//Statistics summed over all executions of prepared statements of connection
+	StatementStats statements;
+
+	//Queries executed by SQLite3::execute and executeQuery
+	uint64_t rawQueries = 0;
+
+	//Failed preparations and executions by primary result code, e.g. errors[SQLITE_CONSTRAINT]
+	static constexpr int errorCodes = 32;
+	std::array<uint64_t, errorCodes> errors{};
+
+	//Executions which failed with SQLITE_BUSY or SQLITE_LOCKED and repeated runs of SQLite3::transaction
+	uint64_t busy = 0;
+	uint64_t transactionRetries = 0;
+
+	//Transactions of TransactionGuard rolled back because commit in its destructor failed
+	uint64_t failedCommits = 0;
+
+	//Requests of SQLite3::cachedStatement served by cached statement and by newly prepared one
+	uint64_t statementCacheHits = 0;
+	uint64_t statementCacheMisses = 0;
+
+	//Page cache of connection as reported by sqlite3_db_status
+	uint64_t pageCacheHits = 0;
+	uint64_t pageCacheMisses = 0;
+	uint64_t pageCacheWrites = 0;
+	uint64_t pageCacheBytes = 0;
+
+	//Size of write-ahead log of main database
+	//In rollback journal modes it is size of journal, which exists only during write transactions
+	uint64_t walBytes = 0;
+};
+
+//Counters of one connection, shared with its statements
+//Updated by statements, read by SQLite3::metrics()
+struct ConnectionCounters
+{
+	std::atomic<uint64_t> timeouts{ 0 };
+	std::atomic<uint64_t> cancellations{ 0 };
+
+	//Sums of StatementStats of executions
+	std::atomic<uint64_t> executions{ 0 };
+	std::atomic<uint64_t> failures{ 0 };
+	std::atomic<uint64_t> rows{ 0 };
+	std::atomic<uint64_t> vmSteps{ 0 };
+	std::atomic<uint64_t> fullScanSteps{ 0 };
+	std::atomic<uint64_t> sorts{ 0 };
+	std::atomic<uint64_t> autoIndexes{ 0 };
+	std::atomic<uint64_t> reprepares{ 0 };
+	std::atomic<uint64_t> timeNs{ 0 };
+	std::atomic<uint64_t> timedExecutions{ 0 };
+
+	std::atomic<uint64_t> rawQueries{ 0 };
+	std::atomic<uint64_t> errors[SQLite3Metrics::errorCodes]{};
+	std::atomic<uint64_t> busy{ 0 };
+	std::atomic<uint64_t> transactionRetries{ 0 };
+	std::atomic<uint64_t> failedCommits{ 0 };
+	std::atomic<uint64_t> statementCacheHits{ 0 };
+	std::atomic<uint64_t> statementCacheMisses{ 0 };
+
+	//Page cache counters of sqlite3_db_status are 31 bit and wrap in long running processes
+	//SQLite3::metrics() reads them without reset and adds their increase since value it has seen last
+	struct PageCacheCounter
+	{
+		std::atomic<uint64_t> total{ 0 };
+		std::atomic<uint32_t> seen{ 0 };
+	};
+	PageCacheCounter pageCacheHits;
+	PageCacheCounter pageCacheMisses;
+	PageCacheCounter pageCacheWrites;
+
+	//Default timing of statements created afterwards, see SQLite3::setTiming
+	bool timing = false;
+
+	//Progress handler set by SQLite3::setProgressHandler, guarded executions call it and restore it when they end
+	int progressInstructions = 0;
+	int (*progressCallback)(void*) = nullptr;
+	void* progressData = nullptr;
+
+	//Innermost running execution with timeout or cancellation token, executions nested in it keep checking it
+	//Owned by MSQLite3.cpp, changed under mutex of connection
+	std::atomic<void*> executionGuard{ nullptr };
+
+	//Adds statistics of one execution
+	//Connection can be shared by threads when SQLite is serialized, so every value is added atomically
+	void add(const StatementStats& execution) noexcept;
+
+	//Counts failure with result code [rc]
+	void error(int rc) noexcept;
+
+	//Returns sums of all executions
+	StatementStats statements() const;
 };
 
 class ColumnNotFound : public SQLite3Error {
@@ -47,87 +319,581 @@ public:
 	{}
 };
 
+//Thrown when execution runs longer than timeout set on statement or connection
+class QueryTimeout : public SQLite3Error {
+public:
+	QueryTimeout(std::chrono::milliseconds timeout)
+		:SQLite3Error(describe(timeout))
+	{}
+
+	QueryTimeout(SQLite3ErrorInfo info)
+		:SQLite3Error(std::move(info))
+	{}
+
+	static SQLite3ErrorInfo describe(std::chrono::milliseconds timeout) {
+		SQLite3ErrorInfo rval = SQLite3ErrorInfo::fromCode(SQLITE_INTERRUPT,
+			"Query was interrupted after timeout of " + std::to_string(timeout.count()) + " ms");
+		rval.timedOut = true;
+		return rval;
+	}
+};
+
+//Thrown when execution is cancelled by CancellationToken or by SQLite3::interrupt
+class QueryCancelled : public SQLite3Error {
+public:
+	QueryCancelled()
+		:SQLite3Error(describe())
+	{}
+
+	QueryCancelled(SQLite3ErrorInfo info)
+		:SQLite3Error(std::move(info))
+	{}
+
+	static SQLite3ErrorInfo describe() {
+		return SQLite3ErrorInfo::fromCode(SQLITE_INTERRUPT, "Query was cancelled");
+	}
+};
+
+//Throws exception matching the error
+[[noreturn]] inline void throwError(SQLite3ErrorInfo info)
+{
+	if (info.timedOut)
+		throw QueryTimeout(std::move(info));
+	if (info.code == SQLITE_INTERRUPT)
+		throw QueryCancelled(std::move(info));
+	throw SQLite3Error(std::move(info));
+}
+
+//Expected holds either value of call or description of its error
+//Returned by non-throwing API (try* methods) for hot paths where exceptions are too expensive
+//example
+/*
+	auto rs = db.tryExecuteQuery("SELECT name FROM User");
+	if (!rs && rs.error().isBusy())
+		retryLater();
+	else
+		use(rs.value());	//value() throws if there is an error
+*/
+template<typename T>
+class Expected
+{
+private:
+	std::variant<T, SQLite3ErrorInfo> state;
+public:
+	Expected(T value)
+		:state(std::in_place_index<0>, std::move(value))
+	{}
+
+	Expected(SQLite3ErrorInfo error)
+		:state(std::in_place_index<1>, std::move(error))
+	{}
+
+	//returns true if call succeeded
+	bool ok() const {
+		return state.index() == 0;
+	}
+
+	explicit operator bool() const {
+		return ok();
+	}
+
+	//returns value or throws error
+	T& value() {
+		if (!ok())
+			throwError(error());
+		return std::get<0>(state);
+	}
+
+	T& operator*() {
+		return std::get<0>(state);
+	}
+
+	T* operator->() {
+		return &std::get<0>(state);
+	}
+
+	//returns error, can be called only if call failed
+	const SQLite3ErrorInfo& error() const {
+		return std::get<1>(state);
+	}
+};
+
+//Result of call which returns nothing
+template<>
+class Expected<void>
+{
+private:
+	SQLite3ErrorInfo err;
+	bool success;
+public:
+	Expected()
+		:success(true)
+	{}
+
+	Expected(SQLite3ErrorInfo error)
+		:err(std::move(error)), success(false)
+	{}
+
+	bool ok() const {
+		return success;
+	}
+
+	explicit operator bool() const {
+		return ok();
+	}
+
+	//throws error if call failed
+	void value() const {
+		if (!success)
+			throwError(err);
+	}
+
+	const SQLite3ErrorInfo& error() const {
+		return err;
+	}
+};
+
+//Token used to cancel running execution from another thread
+//Copies of token share the same state, so one copy is given to statement and other is kept by canceller
+//Cancelled token stays cancelled until reset
+class CancellationToken
+{
+private:
+	std::shared_ptr<std::atomic<bool>> flag;
+public:
+	CancellationToken()
+		:flag(std::make_shared<std::atomic<bool>>(false))
+	{}
+
+	//Requests cancellation, running execution stops with QueryCancelled
+	void cancel() {
+		flag->store(true, std::memory_order_relaxed);
+	}
+
+	bool isCancelled() const {
+		return flag->load(std::memory_order_relaxed);
+	}
+
+	//Makes token usable for next execution
+	void reset() {
+		flag->store(false, std::memory_order_relaxed);
+	}
+};
+
+//Description of one column of result
+struct ResultColumn
+{
+	std::string name;
+
+	//Declared type of column of table, empty for expressions
+	std::string declaredType;
+
+	//Database, table and column the value comes from, empty for expressions
+	//Filled only if SQLite is built with SQLITE_ENABLE_COLUMN_METADATA
+	std::string database;
+	std::string table;
+	std::string origin;
+
+	//Constraints of origin column by sqlite3_table_column_metadata, false and empty for expressions
+	bool notNull = false;
+	bool primaryKey = false;
+	bool autoIncrement = false;
+	std::string collation;
+
+	//Returns true if value comes directly from column of table
+	bool hasOrigin() const {
+		return !origin.empty();
+	}
+};
+
+//Columns of result, shared by all rows of the result
+class ResultSchema
+{
+private:
+	std::vector<ResultColumn> list;
+
+	//Index of first column of every name
+	std::unordered_map<std::string, int> index;
+public:
+	ResultSchema() = default;
+	explicit ResultSchema(std::vector<ResultColumn> columns);
+
+	//Describes columns of prepared statement
+	//Constraints of origin columns are read only if [withConstraints] is set, it needs lookup in schema of database
+	static std::shared_ptr<const ResultSchema> fromStatement(sqlite3_stmt* stmt, bool withConstraints = false);
+
+	//Schema without columns
+	static const std::shared_ptr<const ResultSchema>& empty();
+
+	//Returns index of column of given name, -1 if there is no such column
+	int find(const std::string& name) const {
+		auto it = index.find(name);
+		return it != index.end() ? it->second : -1;
+	}
+
+	size_t size() const {
+		return list.size();
+	}
+
+	const ResultColumn& operator[](size_t i) const {
+		return list[i];
+	}
+
+	std::vector<ResultColumn>::const_iterator begin() const {
+		return list.begin();
+	}
+
+	std::vector<ResultColumn>::const_iterator end() const {
+		return list.end();
+	}
+};
+
+//One row of ResultSet, values are stored by position and names are looked up in schema shared with other rows
+class ResultRow
+{
+public:
+	typedef std::unordered_map<std::string, std::string> Values;
+private:
+	std::shared_ptr<const ResultSchema> schema;
+	std::vector<std::string> values;
+
+	//Returns value for given column name, throws if no such column exist
+	const std::string& value(const std::string& name) const
+	{
+		const int i = schema->find(name);
+		if (i < 0)
+			throw ColumnNotFound(name);
+		return values[i];
+	}
+public:
+	ResultRow()
+		:schema(ResultSchema::empty())
+	{}
+
+	//Row with own schema made of names of values
+	ResultRow(Values&& values);
+
+	//Row of given schema
+	ResultRow(std::shared_ptr<const ResultSchema> schema, std::vector<std::string>&& values)
+		:schema(std::move(schema))
+		,values(std::move(values))
+	{}
+
+	//Reads current row of statement, [schema] has to describe columns of statement
+	ResultRow(std::shared_ptr<const ResultSchema> schema, sqlite3_stmt* stmt);
+
+	//Returns true if row has column of given name
+	bool has(const std::string& name) const {
+		return schema->find(name) >= 0;
+	}
+
+	//Returns columns of row
+	const ResultSchema& columns() const {
+		return *schema;
+	}
+
+	//Returns value of column at given position as text, NULL is empty string
+	const std::string& operator[](size_t index) const {
+		return values[index];
+	}
+
+	//Return value for given column name
+	//Throws if no such column exist
+	template<typename T>
+	T get(const std::string& name) const
+	{
+		T rval{0};
+		std::istringstream ss(value(name));
+		ss >> rval;
+		return rval;
+	}
+};
+
+//explicit specialization for std::string to take also a whitespace
+template<>
+inline std::string ResultRow::get(const std::string& name) const
+{
+	std::string rval{};
+	std::istringstream ss(value(name));
+	std::getline(ss, rval);
+	return rval;
+}
+
+
+//explicit specialization for std::tm to parse date correctly
+template<>
+inline std::tm ResultRow::get(const std::string& name) const
+{
+	std::tm rval{};
+	std::stringstream ss(value(name));
+	ss >> std::get_time(&rval, "%Y-%m-%d %H:%M:%S");
+	return rval;
+}
+
+//Rows returned by query
+//Rows can be read sequentially by current row and next(), or in any order by index and iterators
+//Iterators are random access, so standard algorithms like std::sort or std::lower_bound work on rows in place
+//example
+/*
+	ResultSet rs = db.executeQuery("SELECT name, score FROM User");
+	std::sort(rs.begin(), rs.end(), [](const ResultRow& a, const ResultRow& b) {
+		return a.get<double>("score") < b.get<double>("score");
+	});
+	for (const ResultRow& row : rs)
+		std::cout << row.get<std::string>("name");
+*/
 class ResultSet
 {
 public:
-	//Container type to store and map returned rows/cols
-	typedef std::vector<std::unordered_map<std::string, std::string>> Container;
+	//Container type to store returned rows
+	typedef std::vector<ResultRow> Container;
+	typedef Container::iterator iterator;
+	typedef Container::const_iterator const_iterator;
 private:
 	//Internal container object
 	Container container;
 
-	//Iterator object for container
-	Container::iterator iterator;
+	//Columns of rows added from statement or by sqlite3_exec callback
+	std::shared_ptr<const ResultSchema> schema;
+
+	//Current row
+	size_t cursor;
+
+	//Ranges smaller than this are not worth own thread
+	static constexpr size_t minRowsPerThread = 1024;
+
+	//Splits rows into contiguous ranges and calls [work](part, first, last) for each of them
+	//Every range except the first one runs on its own thread, first exception is rethrown after all finished
+	template<typename F>
+	void partition(F&& work, unsigned threads) const
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		const size_t parts = std::max<size_t>(1, std::min<size_t>(threads, container.size() / minRowsPerThread));
+		const size_t chunk = (container.size() + parts - 1) / std::max<size_t>(1, parts);
+
+		std::vector<std::exception_ptr> errors(parts);
+		auto runPart = [&](size_t part) {
+			try {
+				const size_t first = std::min(part * chunk, container.size());
+				work(part, container.begin() + first, container.begin() + std::min(first + chunk, container.size()));
+			}
+			catch (...) {
+				errors[part] = std::current_exception();
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(parts - 1);
+		for (size_t part = 1; part < parts; ++part)
+			workers.emplace_back(runPart, part);
+		runPart(0);
+		for (auto& worker : workers)
+			worker.join();
+
+		for (auto& error : errors)
+			if (error)
+				std::rethrow_exception(error);
+	}
 public:
 	//Constructor - does nothing special
 	ResultSet();
 
-	ResultSet(sqlite3_stmt * stmt);
+	//Result set whose rows are added from statement described by [schema]
+	explicit ResultSet(std::shared_ptr<const ResultSchema> schema);
+
+	//Steps statement until all rows are read
+	//If [rc] is given result of last step is stored there, SQLITE_DONE on success
+	ResultSet(sqlite3_stmt * stmt, int* rc = nullptr);
 
 	//Add record to the result set
+	//Rows with the same columns share one schema
 	void addRecord(int count, const char** row, const char** cols);
-	void addRecord(Container::value_type&& record);
+	void addRecord(sqlite3_stmt* stmt);
+	void addRecord(ResultRow&& record);
+
+	//Appends all rows of other resultset to this one, other is left empty
+	//Used to gather results of the same query executed over several databases
+	void merge(ResultSet&& other);
 	
 	//Returns true if container is still iterable
-	operator bool();
+	operator bool() {
+		return cursor < container.size();
+	}
 	
 	//Moves to the next row and returns false if it reached end
-	bool next();
+	bool next() {
+		if (cursor < container.size())
+			++cursor;
+		return cursor < container.size();
+	}
+
+	//Moves to row at given index and returns false if index is out of range
+	bool seek(size_t index) {
+		cursor = std::min(index, container.size());
+		return cursor < container.size();
+	}
+
+	//Returns index of current row
+	size_t position() const {
+		return cursor;
+	}
+
+	//Returns columns of result, empty if result was built without statement and has no rows
+	const ResultSchema& columns() const;
 
 	//Return number of rows in resultset
-	size_t count();
+	size_t count() {
+		return container.size();
+	}
+
+	size_t size() const {
+		return container.size();
+	}
+
+	//Returns row at given index, index is not checked
+	ResultRow& operator[](size_t index) {
+		return container[index];
+	}
+
+	const ResultRow& operator[](size_t index) const {
+		return container[index];
+	}
+
+	//Returns current row
+	ResultRow& row() {
+		return container[cursor];
+	}
+
+	iterator begin() {
+		return container.begin();
+	}
+
+	iterator end() {
+		return container.end();
+	}
+
+	const_iterator begin() const {
+		return container.begin();
+	}
+
+	const_iterator end() const {
+		return container.end();
+	}
+
+	//Calls [f] with every row, rows are split into contiguous ranges processed in parallel
+	//[threads] is maximal count of threads, 0 uses count of hardware threads
+	//[f] is called concurrently and must not modify shared state without synchronization
+	template<typename F>
+	void parallelForEach(F f, unsigned threads = 0) const
+	{
+		partition([&f](size_t, const_iterator first, const_iterator last) {
+			for (; first != last; ++first)
+				f(*first);
+		}, threads);
+	}
+
+	//Converts every row by [f] in parallel and returns results in order of rows
+	//[threads] is maximal count of threads, 0 uses count of hardware threads
+	template<typename F>
+	auto transform(F f, unsigned threads = 0) const -> std::vector<typename std::decay<decltype(f(std::declval<const ResultRow&>()))>::type>
+	{
+		typedef typename std::decay<decltype(f(std::declval<const ResultRow&>()))>::type Result;
+		std::vector<std::vector<Result>> parts(threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads);
+		partition([&f, &parts](size_t part, const_iterator first, const_iterator last) {
+			parts[part].reserve(last - first);
+			for (; first != last; ++first)
+				parts[part].push_back(f(*first));
+		}, static_cast<unsigned>(parts.size()));
+
+		std::vector<Result> rval = std::move(parts[0]);
+		rval.reserve(container.size());
+		for (size_t part = 1; part < parts.size(); ++part)
+			std::move(parts[part].begin(), parts[part].end(), std::back_inserter(rval));
+		return rval;
+	}
 
 	//Return value for current row and given column name
 	//Throws if no such column exist
 	template<typename T>
 	T get(const std::string& name)
 	{
-		T rval{0};
-		auto it = iterator->find(name);
-		if (it != iterator->end())
-		{
-			std::istringstream ss(it->second);
-			ss >> rval;
-		}
-		else
-			throw ColumnNotFound(name);
-		return rval;
+		return container[cursor].get<T>(name);
 	}
 };
 
-//explicit specialization for std::string to take also a whitespace
-template<>
-inline std::string ResultSet::get(const std::string& name)
+
+//Counts positional ? placeholders of query at compile time
+//Placeholders inside string literals, quoted identifiers and comments are skipped
+//Returns -1 if query uses numbered (?NNN) or named (:name, @name, $name) parameters,
+//their count can not be told from text alone
+constexpr int countPlaceholders(const char* sql)
 {
-	std::string rval{};
-	auto it = iterator->find(name);
-	if (it != iterator->end())
-	{
-		std::istringstream ss(it->second);
-		std::getline(ss, rval);
+	int count = 0;
+	for (const char* p = sql; *p; ++p) {
+		if (*p == '\'' || *p == '"' || *p == '`' || *p == '[') {
+			//Escaped quote '' ends literal and starts new one, so it needs no special handling
+			const char close = *p == '[' ? ']' : *p;
+			for (++p; *p && *p != close; ++p) {}
+			if (!*p)
+				break;
+		}
+		else if (*p == '-' && p[1] == '-') {
+			while (*p && *p != '\n')
+				++p;
+			if (!*p)
+				break;
+		}
+		else if (*p == '/' && p[1] == '*') {
+			for (p += 2; *p && !(*p == '*' && p[1] == '/'); ++p) {}
+			if (!*p)
+				break;
+			++p;
+		}
+		else if (*p == '?') {
+			if (p[1] >= '0' && p[1] <= '9')
+				return -1;
+			++count;
+		}
+		else if (*p == ':' || *p == '@' || *p == '$')
+			return -1;
 	}
-	else
-		throw ColumnNotFound(name);
-	return rval;
+	return count;
 }
 
-
-//explicit specialization for std::tm to parse date correctly
-template<>
-inline std::tm ResultSet::get(const std::string& name)
+//Query whose count of parameters is known at compile time
+//Created by MSQLITE3_QUERY or MSQLITE3_TYPED_QUERY macro, optional Types are types of parameters in order
+//Statement created from it checks arguments of bind at compile time instead of at run time
+template<int N, typename ...Types>
+class SqlQuery
 {
-	std::tm rval{};
-	auto it = iterator->find(name);
-	if (it != iterator->end())
-	{
-		std::stringstream ss(it->second);
-		ss >> std::get_time(&rval, "%Y-%m-%d %H:%M:%S");
+	static_assert(N >= 0, "Only positional ? parameters can be checked at compile time");
+	static_assert(sizeof...(Types) == 0 || sizeof...(Types) == N, "Count of parameter types does not equal count of parameters in query");
+
+	const char* text;
+public:
+	//Count of parameters in query
+	static constexpr int paramCount = N;
+
+	constexpr explicit SqlQuery(const char* text) :text(text) {}
+
+	constexpr const char* c_str() const {
+		return text;
 	}
-	else
-		throw ColumnNotFound(name);
-	return rval;
-}
+};
 
+//Creates SqlQuery from string literal, MSQLITE3_TYPED_QUERY takes types of parameters after the query
+//Forms are separate because empty variadic arguments of macro are not standard before C++20
+//example
+/*
+	auto ps = db.createPreparedStatement(MSQLITE3_TYPED_QUERY("INSERT INTO User(id, name) VALUES(?, ?)", int, std::string));
+	ps.bind(1, "Alice").execute();
+	ps.reset().bind(2);	//does not compile
+
+	auto count = db.createPreparedStatement(MSQLITE3_QUERY("SELECT count(*) c FROM User WHERE id > ?"), 0);
+*/
+#define MSQLITE3_QUERY(query) SqlQuery<countPlaceholders(query)>(query)
+#define MSQLITE3_TYPED_QUERY(query, ...) SqlQuery<countPlaceholders(query), __VA_ARGS__>(query)
 
 class PreparedStatement
 {
@@ -146,6 +912,76 @@ private:
 	//Count of parameters found in query
 	int paramCount;
 
+	//Counters of connection which created the statement
+	ConnectionCounters* counters;
+
+	//Maximal duration of one execution, zero means no limit
+	std::chrono::milliseconds timeoutMs;
+
+	//Token checked during execution if hasToken is set
+	CancellationToken token;
+	bool hasToken;
+
+	//Kind of last failure, details are built only when lastError is called
+	enum class Failure : char { None, Database, ArgumentCount, Timeout, Cancel };
+	Failure failure;
+
+	//Timeout which stopped last execution, own one or of outer execution it was nested in
+	std::chrono::milliseconds expiredMs;
+
+	//Columns of statement, described on first use, so preparing stays as cheap as sqlite3_prepare_v3
+	//Constraints need lookup in schema of database, they are read only when columns() is called
+	mutable std::shared_ptr<const ResultSchema> schema;
+	mutable bool constrained;
+
+	//Returns columns of statement, they are described on first call
+	const std::shared_ptr<const ResultSchema>& describe() const;
+
+	//Statistics of executions, executions are timed if [timed] is set
+	StatementStats statistics;
+	bool timed;
+
+	//Returns start of execution, only read from clock when executions are timed
+	std::chrono::steady_clock::time_point started() const {
+		return timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+	}
+
+	//Adds execution which started at [start], returned [rows] rows and ended with rc to statistics of statement and connection
+	void record(uint64_t rows, std::chrono::steady_clock::time_point start) noexcept;
+
+	//Execution stepped in parts by tryStep, it lasts from first call after reset until statement ends
+	bool stepping;
+	uint64_t steppedRows;
+	std::chrono::steady_clock::time_point steppingStart;
+
+	//Called by run with statement positioned on returned row
+	typedef void (*RowCallback)(sqlite3_stmt* stmt, void* data);
+
+	//Steps statement to the end, [onRow] is called for every row if given
+	//Returns SQLITE_OK or error code
+	int run(RowCallback onRow, void* data);
+
+	//Steps statement to the end, rows are collected into [rows] if given
+	//Returns SQLITE_OK or error code
+	int run(ResultSet* rows);
+
+	//Steps statement until [maxRows] rows were returned, see tryStep
+	int step(size_t maxRows, RowCallback onRow, void* data);
+
+	template<typename F>
+	static void invokeRow(sqlite3_stmt* stmt, void* data) {
+		(*static_cast<F*>(data))(stmt);
+	}
+
+	//Returns true if execution needs progress handler for timeout or cancellation
+	//Execution nested in guarded one needs it too, it can be stopped by timeout or token of outer one
+	bool guarded() const {
+		return timeoutMs.count() > 0 || hasToken || counters->executionGuard.load(std::memory_order_relaxed);
+	}
+
+	//Records failure of execution which ran without progress handler, returns rc
+	int failed() noexcept;
+
 	//Prepare parameter of floating point type
 	template<typename T>
 	void prepareParam(const T& param, const int index
@@ -153,17 +989,21 @@ private:
 		rc = sqlite3_bind_double(stmt, index, param);
 	}
 
-	//Prepare parameter of integral type
+	//Prepare parameter of integral type whose every value fits into int
 	template<typename T>
 	void prepareParam(const T& param, const int index
-		, typename std::enable_if<std::is_integral<T>::value>::type* = 0){
+		, typename std::enable_if<std::is_integral<T>::value
+			&& std::numeric_limits<T>::digits <= std::numeric_limits<int>::digits>::type* = 0){
 		rc = sqlite3_bind_int(stmt, index, param);
 	}
 
-
-	//Prepare parameter of int64 type
-	void prepareParam(const sqlite_int64 param, const int index) {
-		rc = sqlite3_bind_int64(stmt, index, param);
+	//Prepare parameter of 64-bit integral type or unsigned int, e.g. int64_t, long or uint32_t
+	//uint64_t values above INT64_MAX are stored as negative numbers
+	template<typename T>
+	void prepareParam(const T& param, const int index
+		, typename std::enable_if<std::is_integral<T>::value
+			&& (std::numeric_limits<T>::digits > std::numeric_limits<int>::digits)>::type* = 0){
+		rc = sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(param));
 	}
 
 	//Prepare parameter of const char* type
@@ -187,65 +1027,206 @@ private:
 		prepareParam(static_cast<int>(param), index);
 	}
 
+	//Prepare NULL parameter
+	void prepareParam(std::nullptr_t, const int index) {
+		rc = sqlite3_bind_null(stmt, index);
+	}
+
 
 	//Constructor of object is in private section
 	//It can be only called by SQLite3 component
 	//Params: [db] underlying database pointer
+	//[counters] counters of connection
+	//[timeout] default timeout of connection
 	//[query] string query to prepare
 	//[args] parameters for query
 	template<typename ...Args>
-	PreparedStatement(sqlite3* db, const std::string& query, Args&&... args)
-		:
-		rc(SQLITE_OK)
-		,db(db)
-		,stmt(nullptr)
-		,paramCount(std::count(query.begin(), query.end(), '?'))
+	PreparedStatement(sqlite3* db, ConnectionCounters* counters, std::chrono::milliseconds timeout, const std::string& query, Args&&... args)
+		:PreparedStatement(db, counters, timeout, query, std::nothrow)
 	{	
-		//Prepares query and allocate stmt object
-		rc = sqlite3_prepare_v3(db, query.c_str(),query.length(), 0, &stmt, 0);
-
 		if (rc != SQLITE_OK)
-			throw SQLite3Error(sqlite3_errmsg(db));
+			throw SQLite3Error(SQLite3ErrorInfo::fromDb(db, query.c_str()));
 		
 		//Bind only if there are some arguments
 		if(sizeof...(args) > 0)
 			bind(std::forward<Args>(args)...);
 	}
 
+	//Prepares query and allocate stmt object
+	//Does not throw, result of preparation is left in rc
+	PreparedStatement(sqlite3* db, ConnectionCounters* counters, std::chrono::milliseconds timeout, const std::string& query, std::nothrow_t);
+
 	//So SQLite3 component can create PreparedStatement
 	friend class SQLite3;
+protected:
+	//Binds parameters without checking their count
+	//Returns SQLITE_OK or error code of first failed bind
+	template<typename ...Args>
+	int bindValues(Args&&... args) noexcept {
+		return tryBindAt(1, std::forward<Args>(args)...);
+	}
 public:
+	//Binds given arguments to parameters starting at parameter [position], first parameter has position 1
+	//Count of parameters is not checked, used to fill statements with repeated groups of parameters
+	//Returns SQLITE_OK or error code of first failed bind
+	template<typename ...Args>
+	int tryBindAt(int position, Args&&... args) noexcept {
+		//Prepare all parameters from parameter pack, first failure is kept
+		int index = position - 1;
+		int first = SQLITE_OK;
+		using expander = int[];
+		(void)expander {
+			0, (void(prepareParam(std::forward<Args>(args), ++index)), first = first != SQLITE_OK ? first : rc, 0)...
+		};
+
+		failure = first != SQLITE_OK ? Failure::Database : Failure::None;
+		return rc = first;
+	}
 
 	//Binds given arguments to sql query
 	//Count of arguments have to be the same as the number of questionmarks in query
 	template<typename ...Args>
 	PreparedStatement& bind(Args&&... args) {
-		//Check correct size
-		if (sizeof...(args) != paramCount)
-			throw SQLite3Error("Count of arguments does not equal count of questionmarks");
+		if (tryBind(std::forward<Args>(args)...) != SQLITE_OK)
+			throw SQLite3Error(lastError());
+		return *this;
+	}
 
-		//Prepare all parameters from parameter pack
-		int index = 0;
-		using expander = int[];
-		(void)expander {
-			0, (void(prepareParam(std::forward<Args>(args), ++index)), 0)...
-		};
+	//Non-throwing version of bind
+	//Returns SQLITE_OK or error code of first failed bind, SQLITE_RANGE if count of arguments is wrong
+	template<typename ...Args>
+	int tryBind(Args&&... args) noexcept {
+		//Check correct size
+		if (sizeof...(args) != paramCount) {
+			failure = Failure::ArgumentCount;
+			return rc = SQLITE_RANGE;
+		}
 
-		if (rc != SQLITE_OK)
-			throw SQLite3Error(sqlite3_errmsg(db));
-		return *this;
+		return bindValues(std::forward<Args>(args)...);
 	}
 
 	//Resets the parameters but keeps the query
 	//Is used to fill the same query with new params
-	PreparedStatement& reset();
+	PreparedStatement& reset() {
+		tryReset();
+		return *this;
+	}
+
+	//Non-throwing version of reset, returns SQLITE_OK
+	int tryReset() noexcept {
+		rc = sqlite3_clear_bindings(stmt);
+		rc = sqlite3_reset(stmt);
+		failure = Failure::None;
+		stepping = false;
+		return SQLITE_OK;
+	}
 
 	//Executes statement
-	PreparedStatement& execute();
+	//Throws QueryTimeout or QueryCancelled if execution was interrupted
+	PreparedStatement& execute() {
+		if (tryExecute() != SQLITE_OK)
+			throwError(lastError());
+		return *this;
+	}
+
+	//Non-throwing version of execute
+	//Returns SQLITE_OK or error code, SQLITE_INTERRUPT on timeout or cancellation; details are in lastError()
+	//Statement can be reset and executed again after failure, e.g. after expected constraint violation
+	int tryExecute() noexcept {
+		if (guarded())
+			return run(nullptr, nullptr);
+
+		//Without timeout and token statement is stepped here, so the loop is inlined into caller
+		const auto start = started();
+		uint64_t rows = 0;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+			++rows;
+		record(rows, start);
+		if (rc != SQLITE_DONE)
+			return failed();
+		failure = Failure::None;
+		return SQLITE_OK;
+	}
 	
 	//Executes query
+	//Throws QueryTimeout or QueryCancelled if execution was interrupted
 	ResultSet executeQuery();
 
+	//Non-throwing version of executeQuery
+	Expected<ResultSet> tryExecuteQuery();
+
+	//Executes query and calls [onRow] with statement positioned on every returned row
+	//Values are read directly by sqlite3_column_* functions, no ResultSet is built
+	//Throws QueryTimeout or QueryCancelled if execution was interrupted
+	template<typename F>
+	PreparedStatement& forEachRow(F&& onRow) {
+		typedef typename std::remove_reference<F>::type Callback;
+		if (guarded()) {
+			if (run(&PreparedStatement::invokeRow<Callback>, &onRow) != SQLITE_OK)
+				throwError(lastError());
+			return *this;
+		}
+
+		//Without timeout and token rows are stepped here, so [onRow] is called directly
+		const auto start = started();
+		uint64_t rows = 0;
+		for (; (rc = sqlite3_step(stmt)) == SQLITE_ROW; ++rows)
+			onRow(stmt);
+		record(rows, start);
+		if (rc != SQLITE_DONE) {
+			failed();
+			throwError(lastError());
+		}
+		failure = Failure::None;
+		return *this;
+	}
+
+	//Executes statement in parts, every call steps it until [maxRows] rows were returned or statement ended
+	//[onRow] is called with statement positioned on every returned row
+	//Execution lasts from first call after reset until statement ends: timeout counts from first call,
+	//token is checked in every call and statistics are recorded when statement ends
+	//Returns SQLITE_ROW if more rows can follow, SQLITE_OK if statement ended, otherwise error code described by lastError()
+	template<typename F>
+	int tryStep(size_t maxRows, F&& onRow) {
+		typedef typename std::remove_reference<F>::type Callback;
+		return step(std::max<size_t>(1, maxRows), &PreparedStatement::invokeRow<Callback>, &onRow);
+	}
+
+	//Describes failure of last try* call or of last execution
+	SQLite3ErrorInfo lastError() const;
+
+	//Sets maximal duration of every following execution, zero removes limit
+	//Default is taken from SQLite3::setTimeout
+	PreparedStatement& timeout(std::chrono::milliseconds timeout);
+
+	//Every following execution is stopped when token is cancelled
+	PreparedStatement& cancelWith(const CancellationToken& token);
+
+	//Enables measuring of time of every following execution by steady clock
+	//Default is taken from SQLite3::setTiming
+	PreparedStatement& timing(bool enabled);
+
+	//Returns statistics of all executions of statement since it was prepared
+	//They are also added to SQLite3::metrics() of connection
+	const StatementStats& stats() const {
+		return statistics;
+	}
+
+	//Returns count of parameters of prepared statement as reported by SQLite
+	int parameterCount() const {
+		return sqlite3_bind_parameter_count(stmt);
+	}
+
+	//returns underlying statement for calls which are not covered by wrapper
+	sqlite3_stmt* handle() const {
+		return stmt;
+	}
+
+	//Returns columns returned by statement with their declared types, origin and constraints
+	//Metadata is read on first call and shared with every ResultSet of statement created afterwards,
+	//ResultSets created before carry columns without constraints
+	const ResultSchema& columns() const;
+
 	//Deleted because of stmt memory management
 	PreparedStatement(const PreparedStatement&) = delete;
 	PreparedStatement& operator=(const PreparedStatement&) = delete;
@@ -256,6 +1237,61 @@ public:
 	~PreparedStatement();
 };
 
+//StaticStatement is PreparedStatement created from SqlQuery
+//Count of arguments of bind, and their types if query has them, is checked at compile time,
+//so binding does not check count of arguments at run time
+//Count of parameters is verified against SQLite once when statement is prepared
+template<int N, typename ...Types>
+class StaticStatement : public PreparedStatement
+{
+	template<typename ...Args>
+	static constexpr bool convertible(std::true_type) {
+		return (true && ... && std::is_convertible<Args, Types>::value);
+	}
+
+	template<typename ...Args>
+	static constexpr bool convertible(std::false_type) {
+		return true;
+	}
+
+	template<typename ...Args>
+	static constexpr void check() {
+		static_assert(sizeof...(Args) == N, "Count of arguments does not equal count of parameters in query");
+		static_assert(convertible<Args...>(std::integral_constant<bool, sizeof...(Types) == sizeof...(Args)>()), "Type of argument does not match type of parameter in query");
+	}
+
+	StaticStatement(PreparedStatement&& ps)
+		:PreparedStatement(std::move(ps))
+	{
+		if (parameterCount() != N)
+			throw SQLite3Error(SQLite3ErrorInfo::fromCode(SQLITE_RANGE, "Count of parameters of prepared query does not equal count found at compile time"));
+	}
+
+	friend class SQLite3;
+public:
+	//Binds given arguments to sql query
+	template<typename ...Args>
+	StaticStatement& bind(Args&&... args) {
+		check<Args...>();
+		if (bindValues(std::forward<Args>(args)...) != SQLITE_OK)
+			throw SQLite3Error(lastError());
+		return *this;
+	}
+
+	//Non-throwing version of bind
+	//Returns SQLITE_OK or error code of first failed bind
+	template<typename ...Args>
+	int tryBind(Args&&... args) noexcept {
+		check<Args...>();
+		return bindValues(std::forward<Args>(args)...);
+	}
+
+	StaticStatement& reset() {
+		PreparedStatement::reset();
+		return *this;
+	}
+};
+
 class SQLite3
 {
 private:
@@ -270,9 +1306,30 @@ private:
 
 	//flag to signalize if db is opened
 	bool isOpened;
+
+	//Statements created by cachedStatement, finalized before db is closed
+	std::unordered_map<std::string, PreparedStatement> statementCache;
+
+	//Counters shared with statements, metrics() adds counters of SQLite to them
+	mutable ConnectionCounters counters;
+
+	//Default timeout of executions, zero means no limit
+	std::chrono::milliseconds timeoutMs;
+
+	//Executes sql by sqlite3_exec with timeout of connection
+	//Returns false and fills [error] if execution failed
+	bool run(const char* sql, int (*callback)(void*, int, char**, char**), void* data, SQLite3ErrorInfo& error);
+
+	//Waits before next attempt of transaction, delay grows exponentially with [attempt] and has random part,
+	//so connections which collided do not retry at the same time
+	static void backoff(int attempt);
+
+	//Counts commit which failed in destructor of TransactionGuard
+	friend class TransactionGuard;
 public:
 	//Takes as parameter path to database and create statement
-	SQLite3(const char* dbPath, const char* createStmt = nullptr);
+	//[vfs] is name of registered VFS used to access database file, nullptr uses default VFS
+	SQLite3(const char* dbPath, const char* createStmt = nullptr, const char* vfs = nullptr);
 
 	//closes and dealocates db
 	~SQLite3();
@@ -290,6 +1347,38 @@ public:
 	//returns last inserted id
 	sqlite_int64 lastId() const;
 
+	//returns count of rows changed by last INSERT, UPDATE or DELETE
+	int changes() const;
+
+	//returns underlying connection for calls which are not covered by wrapper
+	sqlite3* handle() const;
+
+	//returns snapshot of metrics
+	//Counters of wrapper can be read from any thread, status of page cache and size of WAL are read from connection
+	//under its mutex. SQLite built multi-thread (SQLITE_THREADSAFE=2) has no such mutex, then it has to be called
+	//where connection is used
+	//Counters of SQLite are not reset, sqlite3_db_status called by application still sees them whole
+	SQLite3Metrics metrics() const;
+
+	//Sets maximal duration of raw queries and default for statements created afterwards
+	//Execution running longer is stopped with QueryTimeout, zero removes limit
+	void setTimeout(std::chrono::milliseconds timeout);
+
+	//Enables measuring of time of executions of statements created afterwards, see PreparedStatement::timing
+	//Time is reported in StatementStats, counters are collected also without timing
+	void setTiming(bool enabled);
+
+	//Stops execution running on this connection, it ends with QueryCancelled
+	//Can be called from any thread
+	void interrupt();
+
+	//Installs progress handler called every [instructions] of virtual machine, returning non-zero stops execution
+	//with QueryCancelled, null [callback] removes it
+	//Executions with timeout or cancellation token use progress handler of connection too, they call this one
+	//at least as often and restore it when they end. Handler installed by sqlite3_progress_handler on handle()
+	//is replaced by first such execution
+	void setProgressHandler(int instructions, int (*callback)(void*), void* data);
+
 	//Following 2 operations are not recommended for security reasons
 	//execute raw sql query
 	void execute(const char* sql);
@@ -297,15 +1386,80 @@ public:
 	//Executes raw sql query andreturn resultset of that query
 	ResultSet executeQuery(const char* sql);
 
+	//Non-throwing versions of execute and executeQuery, errors are returned in Expected
+	Expected<void> tryExecute(const char* sql);
+	Expected<ResultSet> tryExecuteQuery(const char* sql);
+
+	//Non-throwing version of createPreparedStatement, parameters are bound later by bind
+	Expected<PreparedStatement> tryPrepare(const std::string& query);
+
 	//Creates prepared statement for this db connection
 	template<typename ...Args>
 	PreparedStatement createPreparedStatement(const std::string& query,Args&&... args){
-		return PreparedStatement(db,query, std::forward<Args>(args)...);
+		return PreparedStatement(db, &counters, timeoutMs, query, std::forward<Args>(args)...);
+	}
+
+	//Creates prepared statement from query checked at compile time
+	template<int N, typename ...Types, typename ...Args>
+	StaticStatement<N, Types...> createPreparedStatement(const SqlQuery<N, Types...>& query, Args&&... args) {
+		StaticStatement<N, Types...> rval(PreparedStatement(db, &counters, timeoutMs, query.c_str()));
+		if constexpr (sizeof...(args) > 0)
+			rval.bind(std::forward<Args>(args)...);
+		return rval;
 	}
 
+	//Returns statement for given query prepared on this connection
+	//Statement is prepared on first request and kept until connection is closed
+	//Returned statement is already reset so new parameters can be bound
+	PreparedStatement& cachedStatement(const std::string& query);
+
 	void beginTransaction();
 	void endTransaction();
 
+	//Starts transaction which is going to write
+	//Built with MSQLITE3_BEGIN_CONCURRENT it is BEGIN CONCURRENT, which needs SQLite from begin-concurrent branch:
+	//more connections can write at once and conflicts are detected at commit by SQLITE_BUSY_SNAPSHOT
+	//Otherwise it is BEGIN IMMEDIATE, which takes write lock at start
+	void beginWriteTransaction();
+
+	//Runs [body] in transaction started by beginWriteTransaction and commits it
+	//If transaction fails because other connection holds lock or committed conflicting change
+	//(SQLITE_BUSY, SQLITE_BUSY_SNAPSHOT), it is rolled back and [body] runs again, at most [attempts] times
+	//Attempts are separated by exponential backoff; busy timeout set by sqlite3_busy_timeout applies to every attempt
+	//SQLITE_LOCKED is not retried, it is conflict within the same connection which repeating can not resolve
+	//[body] is called with no arguments and may be called repeatedly, so it should not have other side effects
+	template<typename F>
+	void transaction(F body, int attempts = 10)
+	{
+		for (int attempt = 1;; ++attempt) {
+			try {
+				beginWriteTransaction();
+				body();
+				endTransaction();
+				return;
+			}
+			catch (const SQLite3Error& e) {
+				if (inTransaction())
+					tryExecute("ROLLBACK");
+				if (e.code() != SQLITE_BUSY || attempt >= attempts)
+					throw;
+				++counters.transactionRetries;
+			}
+			catch (...) {
+				if (inTransaction())
+					tryExecute("ROLLBACK");
+				throw;
+			}
+			backoff(attempt);
+		}
+	}
+
+	//returns true if transaction was started and not yet ended or rolled back
+	bool inTransaction() const;
+
+	//Quotes identifier, e.g. name of table or column, so it can be placed into sql
+	static std::string quote(const std::string& identifier);
+
 	//converts date to date string in format %y-%m-%d
 	static std::string toString(const std::tm& date);
 
@@ -325,21 +1479,95 @@ public:
 
 	return rs ? rs.get<std::string>("uniqueNumber") : "";
 */
+//If [write] is set transaction is started by beginWriteTransaction, so with MSQLITE3_BEGIN_CONCURRENT
+//guards of more connections can write at once; commit which conflicts fails and transaction is rolled back,
+//use SQLite3::transaction to retry such transactions automatically
+//Destructor can not report failed commit, it rolls transaction back and counts it in SQLite3Metrics::failedCommits;
+//call commit to get the error as exception
 class TransactionGuard
 {
 private:
 	SQLite3 * db;
+	bool committed;
 public:
-	TransactionGuard(SQLite3 * db):db(db){
-		db->beginTransaction();
+	TransactionGuard(SQLite3 * db, bool write = false):db(db),committed(false){
+		if (write)
+			db->beginWriteTransaction();
+		else
+			db->beginTransaction();
+	}
+
+	//Commits transaction, if commit fails transaction is rolled back and SQLite3Error is thrown
+	void commit(){
+		committed = true;
+		try{
+			db->endTransaction();
+		}catch(...){
+			if (db->inTransaction())
+				db->tryExecute("ROLLBACK");
+			throw;
+		}
 	}
 
 	~TransactionGuard(){
+		if (committed)
+			return;
 		try{
 			db->endTransaction();
 		}catch(...){
+			//Failed commit leaves transaction open
+			++db->counters.failedCommits;
+			if (db->inTransaction())
+				db->tryExecute("ROLLBACK");
         }
 	}
 };
 
+//Transaction of one operation which can also run inside transaction of caller
+//If connection is not in transaction, it is started at the inicialization of the object, committed by commit
+//and rolled back at destruction if it was not committed, otherwise the object does nothing
+//example
+/*
+	ScopedTransaction tx(db);
+	for (auto& record : records)
+		insert(record);
+	tx.commit();
+*/
+class ScopedTransaction
+{
+private:
+	SQLite3& db;
+	bool own;
+public:
+	explicit ScopedTransaction(SQLite3& db)
+		:db(db)
+		,own(!db.inTransaction())
+	{
+		if (own)
+			db.beginTransaction();
+	}
+
+	//Returns true if transaction was started by this object and is not yet committed
+	bool owned() const {
+		return own;
+	}
+
+	//Commits own transaction, if commit fails transaction is rolled back at destruction
+	void commit() {
+		if (own) {
+			db.endTransaction();
+			own = false;
+		}
+	}
+
+	~ScopedTransaction()
+	{
+		if (own && db.inTransaction())
+			db.tryExecute("ROLLBACK");
+	}
+
+	ScopedTransaction(const ScopedTransaction&) = delete;
+	ScopedTransaction& operator=(const ScopedTransaction&) = delete;
+};
+
 #endif
@@ -0,0 +1,285 @@
+#include "MSQLite3Arrow.h"
+#include "MSQLite3BulkInsert.h"
+#include <cstring>
+
+namespace {
+
+//Arrow format string of column type
+const char* formatOf(ColumnType type)
+{
+	switch (type) {
+	case ColumnType::Integer: return "l";
+	case ColumnType::Real: return "g";
+	case ColumnType::Blob: return "z";
+	default: return "u";
+	}
+}
+
+//Owns buffers of one exported column
+struct ColumnData
+{
+	ColumnBuffer column;
+	const void* buffers[3];
+};
+
+void releaseColumn(ArrowArray* array)
+{
+	delete static_cast<ColumnData*>(array->private_data);
+	array->release = nullptr;
+}
+
+//Owns children of exported batch
+struct BatchData
+{
+	std::vector<ArrowArray> children;
+	std::vector<ArrowArray*> pointers;
+	const void* buffers[1] = { nullptr };
+};
+
+void releaseBatch(ArrowArray* array)
+{
+	BatchData* data = static_cast<BatchData*>(array->private_data);
+	//Consumer may have moved children out, moved child has release set to null
+	for (auto& child : data->children)
+		if (child.release)
+			child.release(&child);
+	delete data;
+	array->release = nullptr;
+}
+
+//Owns strings and children of exported schema
+struct SchemaData
+{
+	std::string format;
+	std::string name;
+	std::vector<ArrowSchema> children;
+	std::vector<ArrowSchema*> pointers;
+};
+
+void releaseSchema(ArrowSchema* schema)
+{
+	SchemaData* data = static_cast<SchemaData*>(schema->private_data);
+	for (auto& child : data->children)
+		if (child.release)
+			child.release(&child);
+	delete data;
+	schema->release = nullptr;
+}
+
+void fillSchema(ArrowSchema* out, SchemaData* data, int64_t flags)
+{
+	out->format = data->format.c_str();
+	out->name = data->name.c_str();
+	out->metadata = nullptr;
+	out->flags = flags;
+	out->n_children = static_cast<int64_t>(data->pointers.size());
+	out->children = data->pointers.empty() ? nullptr : data->pointers.data();
+	out->dictionary = nullptr;
+	out->release = releaseSchema;
+	out->private_data = data;
+}
+
+void exportColumn(ColumnBuffer&& column, size_t rows, ArrowArray* out)
+{
+	ColumnData* data = new ColumnData{ std::move(column), {} };
+	ColumnBuffer& c = data->column;
+	data->buffers[0] = c.nullCount ? c.validity.data() : nullptr;
+	switch (c.type) {
+	case ColumnType::Integer:
+		data->buffers[1] = c.integers.data();
+		out->n_buffers = 2;
+		break;
+	case ColumnType::Real:
+		data->buffers[1] = c.reals.data();
+		out->n_buffers = 2;
+		break;
+	case ColumnType::Text:
+	case ColumnType::Blob:
+		//Data buffer must not be null even if all values are empty
+		if (c.chars.capacity() == 0)
+			c.chars.reserve(1);
+		data->buffers[1] = c.offsets.data();
+		data->buffers[2] = c.chars.data();
+		out->n_buffers = 3;
+		break;
+	}
+
+	out->length = static_cast<int64_t>(rows);
+	out->null_count = static_cast<int64_t>(c.nullCount);
+	out->offset = 0;
+	out->n_children = 0;
+	out->buffers = data->buffers;
+	out->children = nullptr;
+	out->dictionary = nullptr;
+	out->release = releaseColumn;
+	out->private_data = data;
+}
+
+
+//Reads values of one child of imported struct array
+struct ImportColumn
+{
+	char format;
+	//Index of first element in buffers, offsets of parent and child together
+	int64_t offset;
+	const uint8_t* validity;
+	const void* values;
+	const char* data;
+
+	ImportColumn(const ArrowSchema* schema, const ArrowArray* array, int64_t parentOffset)
+		:format(schema->format[0])
+		,offset(parentOffset + array->offset)
+		,validity(array->n_buffers > 0 ? static_cast<const uint8_t*>(array->buffers[0]) : nullptr)
+		,values(array->n_buffers > 1 ? array->buffers[1] : nullptr)
+		,data(array->n_buffers > 2 ? static_cast<const char*>(array->buffers[2]) : nullptr)
+	{
+		if (schema->format[1] != '\0' || !strchr("cCsSiIlLfgbuzUZ", format))
+			throw SQLite3Error(std::string("Arrow format ") + schema->format + " of column " + (schema->name ? schema->name : "") + " is not supported");
+	}
+
+	//Binds value of [row] to parameter [param]
+	int bind(sqlite3_stmt* stmt, int param, int64_t row) const
+	{
+		const int64_t i = offset + row;
+		if (validity && !(validity[i >> 3] & (1u << (i & 7))))
+			return sqlite3_bind_null(stmt, param);
+		switch (format) {
+		case 'c': return sqlite3_bind_int(stmt, param, static_cast<const int8_t*>(values)[i]);
+		case 'C': return sqlite3_bind_int(stmt, param, static_cast<const uint8_t*>(values)[i]);
+		case 's': return sqlite3_bind_int(stmt, param, static_cast<const int16_t*>(values)[i]);
+		case 'S': return sqlite3_bind_int(stmt, param, static_cast<const uint16_t*>(values)[i]);
+		case 'i': return sqlite3_bind_int(stmt, param, static_cast<const int32_t*>(values)[i]);
+		case 'I': return sqlite3_bind_int64(stmt, param, static_cast<const uint32_t*>(values)[i]);
+		case 'l': return sqlite3_bind_int64(stmt, param, static_cast<const int64_t*>(values)[i]);
+		//Values above INT64_MAX wrap, SQLite has no unsigned 64-bit type
+		case 'L': return sqlite3_bind_int64(stmt, param, static_cast<sqlite3_int64>(static_cast<const uint64_t*>(values)[i]));
+		case 'f': return sqlite3_bind_double(stmt, param, static_cast<const float*>(values)[i]);
+		case 'g': return sqlite3_bind_double(stmt, param, static_cast<const double*>(values)[i]);
+		case 'b': return sqlite3_bind_int(stmt, param, (static_cast<const uint8_t*>(values)[i >> 3] >> (i & 7)) & 1);
+		case 'u':
+		case 'z': {
+			const int32_t* offsets = static_cast<const int32_t*>(values);
+			return bindBytes(stmt, param, offsets[i], offsets[i + 1]);
+		}
+		default: {
+			const int64_t* offsets = static_cast<const int64_t*>(values);
+			return bindBytes(stmt, param, offsets[i], offsets[i + 1]);
+		}
+		}
+	}
+
+	int bindBytes(sqlite3_stmt* stmt, int param, int64_t first, int64_t last) const
+	{
+		//Buffers outlive execution of statement, so values are not copied by SQLite
+		if (format == 'u' || format == 'U')
+			return sqlite3_bind_text64(stmt, param, data + first, last - first, SQLITE_STATIC, SQLITE_UTF8);
+		return sqlite3_bind_blob64(stmt, param, data + first, last - first, SQLITE_STATIC);
+	}
+};
+
+}
+
+ArrowExporter::ArrowExporter(PreparedStatement& ps, size_t batchSize)
+	:reader(ps, batchSize)
+	,started(false)
+{
+}
+
+bool ArrowExporter::next(ArrowArray* out)
+{
+	started = true;
+	if (!reader.next())
+		return false;
+	exportBatch(reader.take(), out);
+	return true;
+}
+
+void ArrowExporter::schema(ArrowSchema* out) const
+{
+	if (!started)
+		throw SQLite3Error("Schema of exported rows is known after first call of next");
+	exportSchema(reader.batch(), out);
+}
+
+void ArrowExporter::exportBatch(ColumnBatch&& batch, ArrowArray* out)
+{
+	BatchData* data = new BatchData();
+	data->children.resize(batch.width());
+	data->pointers.resize(batch.width());
+	for (size_t i = 0; i < batch.width(); ++i) {
+		exportColumn(std::move(batch.column(i)), batch.size(), &data->children[i]);
+		data->pointers[i] = &data->children[i];
+	}
+
+	out->length = static_cast<int64_t>(batch.size());
+	out->null_count = 0;
+	out->offset = 0;
+	out->n_buffers = 1;
+	out->n_children = static_cast<int64_t>(batch.width());
+	out->buffers = data->buffers;
+	out->children = data->pointers.empty() ? nullptr : data->pointers.data();
+	out->dictionary = nullptr;
+	out->release = releaseBatch;
+	out->private_data = data;
+}
+
+void ArrowExporter::exportSchema(const ColumnBatch& batch, ArrowSchema* out)
+{
+	SchemaData* data = new SchemaData{ "+s", "", {}, {} };
+	data->children.resize(batch.width());
+	data->pointers.resize(batch.width());
+	for (size_t i = 0; i < batch.width(); ++i) {
+		const ColumnBuffer& column = batch.column(i);
+		fillSchema(&data->children[i], new SchemaData{ formatOf(column.type), column.name, {}, {} }, ARROW_FLAG_NULLABLE);
+		data->pointers[i] = &data->children[i];
+	}
+	fillSchema(out, data, 0);
+}
+
+size_t ArrowImporter::import(SQLite3& db, const std::string& table, const ArrowSchema* schema, const ArrowArray* array, const ArrowImportOptions& options)
+{
+	if (!array->release || !schema->release)
+		throw SQLite3Error("Arrow array or schema is already released");
+	if (strcmp(schema->format, "+s") != 0 || schema->n_children != array->n_children || array->n_children == 0)
+		throw SQLite3Error("Imported Arrow array has to be struct array with at least one column");
+
+	std::vector<std::string> names;
+	std::vector<ImportColumn> columns;
+	for (int64_t i = 0; i < schema->n_children; ++i) {
+		names.push_back(schema->children[i]->name ? schema->children[i]->name : "");
+		columns.emplace_back(schema->children[i], array->children[i], array->offset);
+	}
+
+	const size_t rowsPerStatement = MultiRowInsert::rowsPerStatement(db.handle(), columns.size(), options.rowsPerStatement);
+	const size_t rowsPerTransaction = std::max(options.rowsPerTransaction, rowsPerStatement);
+
+	const size_t total = static_cast<size_t>(array->length);
+	ScopedTransaction transaction(db);
+	size_t inserted = 0;
+	size_t uncommitted = 0;
+	//Statement with full count of rows is looked up once, tail statement is used at most once
+	PreparedStatement& full = db.cachedStatement(MultiRowInsert::sql(table, names, rowsPerStatement));
+	while (inserted < total) {
+		const size_t rows = std::min(rowsPerStatement, total - inserted);
+		PreparedStatement& ps = rows == rowsPerStatement ? full.reset() : db.cachedStatement(MultiRowInsert::sql(table, names, rows));
+
+		sqlite3_stmt* stmt = ps.handle();
+		int param = 0;
+		for (size_t row = 0; row < rows; ++row)
+			for (auto& column : columns)
+				if (column.bind(stmt, ++param, static_cast<int64_t>(inserted + row)) != SQLITE_OK)
+					throw SQLite3Error(SQLite3ErrorInfo::fromDb(db.handle(), sqlite3_sql(stmt)));
+		ps.execute();
+
+		inserted += rows;
+		uncommitted += rows;
+		//Own transaction is committed in chunks, so failure rolls back only the current chunk
+		if (transaction.owned() && uncommitted >= rowsPerTransaction && inserted < total) {
+			db.endTransaction();
+			db.beginTransaction();
+			uncommitted = 0;
+		}
+	}
+	transaction.commit();
+	return inserted;
+}
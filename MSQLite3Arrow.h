@@ -0,0 +1,115 @@
+#ifndef MSQLite3ArrowH
+#define MSQLite3ArrowH
+#include "MSQLite3Batch.h"
+
+//Structures of Arrow C Data Interface, https://arrow.apache.org/docs/format/CDataInterface.html
+//Defined here so no Arrow library is needed, guard is shared with Arrow headers
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+	void (*release)(struct ArrowSchema*);
+	void* private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+	void (*release)(struct ArrowArray*);
+	void* private_data;
+};
+
+}
+
+#endif
+
+//ArrowExporter executes statement and exports returned rows as Arrow record batches
+//Every batch is struct array with one child per column, INTEGER columns are int64, REAL float64,
+//TEXT utf8 and BLOB binary, all columns are nullable
+//Buffers filled by stepping the statement are moved into exported arrays without copying,
+//they are freed when consumer calls release
+//example
+/*
+	auto ps = db.createPreparedStatement("SELECT * FROM Item");
+	ArrowExporter exporter(ps);
+	ArrowArray batch;
+	ArrowSchema schema;
+	while (exporter.next(&batch)) {
+		exporter.schema(&schema);
+		consume(&schema, &batch);	//consumer releases both
+	}
+*/
+class ArrowExporter
+{
+private:
+	BatchReader reader;
+	bool started;
+public:
+	//[batchSize] is maximal count of rows of one exported array
+	ArrowExporter(PreparedStatement& ps, size_t batchSize = 65536);
+
+	//Exports next batch into [out], returns false and leaves [out] untouched if there are no rows left
+	//Throws SQLite3Error if stepping fails
+	bool next(ArrowArray* out);
+
+	//Exports schema of batches into [out], columns are known after first call of next
+	void schema(ArrowSchema* out) const;
+
+	//Exports columns of batch as struct array and schema
+	static void exportBatch(ColumnBatch&& batch, ArrowArray* out);
+	static void exportSchema(const ColumnBatch& batch, ArrowSchema* out);
+};
+
+//Options of ArrowImporter::import
+struct ArrowImportOptions
+{
+	//Count of rows inserted by one statement, 0 uses MultiRowInsert::defaultRows, lowered if limit of parameters is smaller
+	size_t rowsPerStatement = 0;
+
+	//Count of rows committed together when import runs outside of transaction
+	size_t rowsPerTransaction = 100000;
+};
+
+//ArrowImporter inserts rows of Arrow record batch into table
+//Children of struct array are matched to table columns by name of field
+//Values are bound straight from Arrow buffers into cached INSERT statements with many rows per VALUES clause
+//Supported formats are signed and unsigned integers, float32, float64, boolean, utf8, binary and their large variants
+//If connection is already in transaction rows become part of it, otherwise rows are committed in chunks
+//and when import fails only the current chunk is rolled back
+//example
+/*
+	ArrowSchema schema;
+	ArrowArray batch;
+	produce(&schema, &batch);
+	ArrowImporter::import(db, "Item", &schema, &batch);
+	batch.release(&batch);
+	schema.release(&schema);
+*/
+class ArrowImporter
+{
+public:
+	//Inserts all rows of [array] described by [schema] into [table], returns count of inserted rows
+	//Throws SQLite3Error if format of column is not supported
+	static size_t import(SQLite3& db, const std::string& table, const ArrowSchema* schema, const ArrowArray* array, const ArrowImportOptions& options = ArrowImportOptions());
+};
+
+#endif
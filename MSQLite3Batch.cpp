@@ -0,0 +1,152 @@
+#include "MSQLite3Batch.h"
+#include <cctype>
+
+namespace {
+
+//Type of column by SQLite affinity rules of declared type, false if declaration does not decide it
+bool declaredType(const char* declaration, ColumnType& type)
+{
+	if (!declaration)
+		return false;
+	std::string declared(declaration);
+	for (char& c : declared)
+		c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+
+	if (declared.find("INT") != std::string::npos)
+		type = ColumnType::Integer;
+	else if (declared.find("CHAR") != std::string::npos || declared.find("CLOB") != std::string::npos || declared.find("TEXT") != std::string::npos)
+		type = ColumnType::Text;
+	else if (declared.find("REAL") != std::string::npos || declared.find("FLOA") != std::string::npos || declared.find("DOUB") != std::string::npos)
+		type = ColumnType::Real;
+	else
+		return false;
+	return true;
+}
+
+//Type of column by type of value
+ColumnType valueType(int type)
+{
+	switch (type) {
+	case SQLITE_INTEGER: return ColumnType::Integer;
+	case SQLITE_FLOAT: return ColumnType::Real;
+	case SQLITE_BLOB: return ColumnType::Blob;
+	default: return ColumnType::Text;
+	}
+}
+
+}
+
+//------------------------ColumnBuffer-----------------------------//
+
+void ColumnBuffer::clear()
+{
+	integers.clear();
+	reals.clear();
+	chars.clear();
+	offsets.clear();
+	if (type == ColumnType::Text || type == ColumnType::Blob)
+		offsets.push_back(0);
+	validity.clear();
+	nullCount = 0;
+}
+
+void ColumnBuffer::append(sqlite3_stmt* stmt, int index, size_t row)
+{
+	if ((row & 7) == 0)
+		validity.push_back(0);
+	const bool null = sqlite3_column_type(stmt, index) == SQLITE_NULL;
+	if (null)
+		++nullCount;
+	else
+		validity.back() |= static_cast<uint8_t>(1u << (row & 7));
+
+	switch (type) {
+	case ColumnType::Integer:
+		integers.push_back(sqlite3_column_int64(stmt, index));
+		break;
+	case ColumnType::Real:
+		reals.push_back(sqlite3_column_double(stmt, index));
+		break;
+	case ColumnType::Text:
+	case ColumnType::Blob:
+		if (!null) {
+			const char* data = type == ColumnType::Text
+				? reinterpret_cast<const char*>(sqlite3_column_text(stmt, index))
+				: static_cast<const char*>(sqlite3_column_blob(stmt, index));
+			chars.insert(chars.end(), data, data + sqlite3_column_bytes(stmt, index));
+		}
+		offsets.push_back(static_cast<int32_t>(chars.size()));
+		break;
+	}
+}
+
+//------------------------ColumnBatch-----------------------------//
+
+const ColumnBuffer& ColumnBatch::column(const std::string& name) const
+{
+	for (auto& buffer : buffers)
+		if (buffer.name == name)
+			return buffer;
+	throw ColumnNotFound(name);
+}
+
+//------------------------BatchReader-----------------------------//
+
+BatchReader::BatchReader(PreparedStatement& ps, size_t batchSize)
+	:ps(ps)
+	,batchSize(std::max<size_t>(1, batchSize))
+	,typed(false)
+	,finished(false)
+{
+}
+
+void BatchReader::describe(sqlite3_stmt* stmt, bool hasRow)
+{
+	current.buffers.resize(sqlite3_column_count(stmt));
+	for (int i = 0; i < static_cast<int>(current.buffers.size()); ++i) {
+		ColumnBuffer& buffer = current.buffers[i];
+		buffer.name = sqlite3_column_name(stmt, i);
+		if (!declaredType(sqlite3_column_decltype(stmt, i), buffer.type))
+			buffer.type = hasRow ? valueType(sqlite3_column_type(stmt, i)) : ColumnType::Text;
+		buffer.clear();
+	}
+	typed = true;
+}
+
+ColumnBatch BatchReader::take()
+{
+	ColumnBatch rval = std::move(current);
+	current = ColumnBatch();
+	current.buffers.resize(rval.buffers.size());
+	for (size_t i = 0; i < rval.buffers.size(); ++i) {
+		current.buffers[i].name = rval.buffers[i].name;
+		current.buffers[i].type = rval.buffers[i].type;
+	}
+	return rval;
+}
+
+bool BatchReader::next()
+{
+	for (auto& buffer : current.buffers)
+		buffer.clear();
+	current.rows = 0;
+	if (finished)
+		return false;
+
+	//Execution goes through statement, so its timeout, token and statistics apply
+	const int rc = ps.tryStep(batchSize, [this](sqlite3_stmt* stmt) {
+		if (!typed)
+			describe(stmt, true);
+		for (int i = 0; i < static_cast<int>(current.buffers.size()); ++i)
+			current.buffers[i].append(stmt, i, current.rows);
+		++current.rows;
+	});
+	if (rc != SQLITE_ROW) {
+		finished = true;
+		if (rc != SQLITE_OK)
+			throwError(ps.lastError());
+		if (!typed)
+			describe(ps.handle(), false);
+	}
+	return current.rows > 0;
+}
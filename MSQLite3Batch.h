@@ -0,0 +1,133 @@
+#ifndef MSQLite3BatchH
+#define MSQLite3BatchH
+#include "MSQLite3.h"
+
+//Physical type of column of ColumnBatch
+enum class ColumnType
+{
+	//Values are in integers
+	Integer,
+	//Values are in reals
+	Real,
+	//Values are UTF-8 strings in chars, delimited by offsets
+	Text,
+	//Values are byte strings in chars, delimited by offsets
+	Blob
+};
+
+//Values of one column of batch stored contiguously, layout follows Arrow columnar format
+//Only buffer of column type is filled, NULL values have zero or empty value in it
+class ColumnBuffer
+{
+public:
+	std::string name;
+	ColumnType type = ColumnType::Text;
+
+	//Fixed width values of Integer and Real columns, one per row
+	std::vector<int64_t> integers;
+	std::vector<double> reals;
+
+	//Value of row i of Text and Blob columns is chars[offsets[i], offsets[i + 1])
+	std::vector<int32_t> offsets;
+	std::vector<char> chars;
+
+	//Bit i (least significant first) is set if value of row i is not NULL
+	std::vector<uint8_t> validity;
+	size_t nullCount = 0;
+
+	bool isNull(size_t row) const {
+		return !(validity[row >> 3] & (1u << (row & 7)));
+	}
+
+	//Returns value of Text or Blob column
+	std::string text(size_t row) const {
+		return std::string(chars.data() + offsets[row], offsets[row + 1] - offsets[row]);
+	}
+private:
+	//Empties buffers but keeps their capacity
+	void clear();
+
+	//Appends value of column [index] of current row of [stmt]
+	void append(sqlite3_stmt* stmt, int index, size_t row);
+
+	friend class BatchReader;
+};
+
+//Rows read by one BatchReader::next call, stored by columns
+class ColumnBatch
+{
+private:
+	std::vector<ColumnBuffer> buffers;
+	size_t rows = 0;
+
+	friend class BatchReader;
+public:
+	//Returns count of rows in batch
+	size_t size() const {
+		return rows;
+	}
+
+	//Returns count of columns
+	size_t width() const {
+		return buffers.size();
+	}
+
+	const ColumnBuffer& column(size_t index) const {
+		return buffers[index];
+	}
+
+	ColumnBuffer& column(size_t index) {
+		return buffers[index];
+	}
+
+	//Throws ColumnNotFound if no column has given name
+	const ColumnBuffer& column(const std::string& name) const;
+};
+
+//BatchReader executes statement and reads returned rows in batches of fixed size into columnar buffers,
+//so values of one column can be processed by tight loops over contiguous arrays
+//Type of column is taken from its declared type, or from type of value in first row for expressions;
+//values of other type are converted to type of column by SQLite
+//Columns are known after first call of next, also when query returned no rows
+//Buffers of batch are reused by following call of next, so they should be consumed before it
+//Statement is executed incrementally by PreparedStatement::tryStep: timeout of statement counts from first call of next,
+//token is checked while batches are read and statistics of statement are recorded when last batch was read
+//example
+/*
+	auto ps = db.createPreparedStatement("SELECT id, price FROM Item WHERE shop = ?", shopId);
+	BatchReader reader(ps, 1024);
+	while (reader.next()) {
+		const ColumnBuffer& price = reader.batch().column(1);
+		total += std::accumulate(price.reals.begin(), price.reals.end(), 0.0);
+	}
+*/
+class BatchReader
+{
+private:
+	PreparedStatement& ps;
+	size_t batchSize;
+	ColumnBatch current;
+	bool typed;
+	bool finished;
+
+	//Decides type of every column by declared types and, if [hasRow] is set, by values of current row
+	void describe(sqlite3_stmt* stmt, bool hasRow);
+public:
+	//[batchSize] is maximal count of rows of one batch
+	BatchReader(PreparedStatement& ps, size_t batchSize = 1024);
+
+	//Reads next batch, returns false if there are no rows left
+	//Throws SQLite3Error if stepping fails, QueryTimeout or QueryCancelled if execution was interrupted
+	bool next();
+
+	//Returns batch read by last call of next
+	const ColumnBatch& batch() const {
+		return current;
+	}
+
+	//Moves batch read by last call of next out of reader, buffers are not reused then
+	//Columns of reader keep their names and types
+	ColumnBatch take();
+};
+
+#endif
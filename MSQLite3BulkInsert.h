@@ -0,0 +1,148 @@
+#ifndef MSQLite3BulkInsertH
+#define MSQLite3BulkInsertH
+#include "MSQLite3.h"
+#include <iterator>
+#include <tuple>
+
+//Generates INSERT statements with many rows in one VALUES clause
+class MultiRowInsert
+{
+public:
+	//Default maximal count of rows of one statement, larger statements are not faster
+	static constexpr size_t defaultRows = 100;
+
+	//INSERT statement with [rows] groups of parameters in VALUES clause
+	static std::string sql(const std::string& table, const std::vector<std::string>& columns, size_t rows)
+	{
+		std::string names, row;
+		for (auto& column : columns) {
+			names += (names.empty() ? "" : ",") + SQLite3::quote(column);
+			row += row.empty() ? "(?" : ",?";
+		}
+		row += ")";
+
+		std::string rval = "INSERT INTO " + SQLite3::quote(table) + "(" + names + ") VALUES";
+		rval.reserve(rval.size() + rows * (row.size() + 1));
+		for (size_t i = 0; i < rows; ++i)
+			rval += (i ? "," : "") + row;
+		return rval;
+	}
+
+	//Count of rows of one statement, [requested] is limited by count of parameters allowed on connection
+	//0 requests defaultRows
+	static size_t rowsPerStatement(sqlite3* db, size_t columnCount, size_t requested)
+	{
+		const size_t maxVariables = static_cast<size_t>(sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+		const size_t rows = requested ? requested : defaultRows;
+		return std::max<size_t>(1, std::min(rows, maxVariables / std::max<size_t>(1, columnCount)));
+	}
+};
+
+//BulkInsert inserts ranges of records by statements which insert many rows at once
+//One statement with full count of rows and statements for shorter tails are cached on connection,
+//so every step of SQLite inserts up to rowsPerStatement rows
+//Column types are given as template parameters in the same order as column names
+//example
+/*
+	BulkInsert<int, std::string, double> insertUsers(db, "User", { "id", "name", "score" }, 100);
+
+	std::vector<std::tuple<int, std::string, double>> users = ...;
+	insertUsers(users);
+*/
+template<typename ...Columns>
+class BulkInsert
+{
+private:
+	SQLite3& db;
+	std::string table;
+	std::vector<std::string> columns;
+	size_t rows;
+
+	//Statement with full count of rows
+	std::string fullSql;
+
+	template<typename Tuple, size_t ...I>
+	int bindRecord(PreparedStatement& ps, int position, const Tuple& record, std::index_sequence<I...>)
+	{
+		return ps.tryBindAt(position, std::get<I>(record)...);
+	}
+public:
+	//[table] name of table, [columns] names of columns in order of template parameters
+	//[rowsPerStatement] count of rows inserted by one statement, 0 uses MultiRowInsert::defaultRows
+	//Count is lowered if statement would have more parameters than connection allows
+	BulkInsert(SQLite3& db, const std::string& table, const std::vector<std::string>& columns, size_t rowsPerStatement = 0)
+		:db(db)
+		,table(table)
+		,columns(columns)
+		,rows(MultiRowInsert::rowsPerStatement(db.handle(), sizeof...(Columns), rowsPerStatement))
+		,fullSql(MultiRowInsert::sql(table, columns, rows))
+	{
+		if (columns.size() != sizeof...(Columns))
+			throw SQLite3Error("Count of column names does not equal count of column types");
+	}
+
+	//Returns count of rows inserted by one statement
+	size_t rowsPerStatement() const {
+		return rows;
+	}
+
+	//Inserts range of records, record is std::tuple<Columns...> or other tuple-like type
+	//Iterator has to be forward iterator, records are counted before they are inserted
+	//Iterator may return records by value, such records are kept until statement which binds them is executed
+	//If connection is already in transaction records become part of it,
+	//otherwise transaction is rolled back when any record fails
+	//Returns count of inserted records
+	template<typename Iterator>
+	size_t insert(Iterator first, Iterator last)
+	{
+		static_assert(std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>::value,
+			"BulkInsert needs forward iterator");
+		typedef decltype(*first) Reference;
+		typedef typename std::decay<Reference>::type Record;
+
+		//Values are bound without copying, so records returned by value are held until execution
+		std::vector<Record> held;
+		if constexpr (!std::is_reference<Reference>::value)
+			held.reserve(rows);
+
+		ScopedTransaction transaction(db);
+		size_t inserted = 0;
+		PreparedStatement& full = db.cachedStatement(fullSql);
+		for (size_t remaining = std::distance(first, last); remaining > 0;) {
+			const size_t count = std::min(rows, remaining);
+			PreparedStatement& ps = count == rows ? full.reset() : db.cachedStatement(MultiRowInsert::sql(table, columns, count));
+			for (size_t row = 0; row < count; ++row, ++first) {
+				const int position = static_cast<int>(row * sizeof...(Columns) + 1);
+				int rc;
+				if constexpr (std::is_reference<Reference>::value)
+					rc = bindRecord(ps, position, *first, std::index_sequence_for<Columns...>());
+				else {
+					held.push_back(*first);
+					rc = bindRecord(ps, position, held.back(), std::index_sequence_for<Columns...>());
+				}
+				if (rc != SQLITE_OK)
+					throw SQLite3Error(ps.lastError());
+			}
+			ps.execute();
+			held.clear();
+			inserted += count;
+			remaining -= count;
+		}
+		transaction.commit();
+		return inserted;
+	}
+
+	template<typename Range>
+	size_t insert(const Range& records)
+	{
+		return insert(std::begin(records), std::end(records));
+	}
+
+	template<typename Range>
+	size_t operator()(const Range& records)
+	{
+		return insert(records);
+	}
+};
+
+#endif
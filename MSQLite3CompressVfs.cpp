@@ -0,0 +1,1019 @@
+#include "MSQLite3CompressVfs.h"
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+//------------------------File format-----------------------------//
+
+//File starts with magic, then records follow
+//Record header: logical offset (8), raw size (4), stored size (4), flags (4), header checksum (4)
+//followed by stored bytes and their checksum (4)
+const char fileMagic[16] = { 'M','S','Q','L','i','t','e','3','-','L','Z','v','1',0,0,0 };
+const int headerSize = 24;
+const int trailerSize = 4;
+
+const uint32_t flagCompressed = 1;
+const uint32_t flagTruncate = 2;
+
+struct RecordHeader
+{
+	sqlite3_int64 offset;
+	uint32_t rawSize;
+	uint32_t storedSize;
+	uint32_t flags;
+};
+
+uint32_t checksum(const char* data, size_t size)
+{
+	//FNV-1a
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < size; ++i)
+		h = (h ^ static_cast<unsigned char>(data[i])) * 16777619u;
+	return h;
+}
+
+void encodeHeader(const RecordHeader& h, char* out)
+{
+	std::memcpy(out, &h.offset, 8);
+	std::memcpy(out + 8, &h.rawSize, 4);
+	std::memcpy(out + 12, &h.storedSize, 4);
+	std::memcpy(out + 16, &h.flags, 4);
+	uint32_t sum = checksum(out, 20);
+	std::memcpy(out + 20, &sum, 4);
+}
+
+bool decodeHeader(const char* in, RecordHeader& h)
+{
+	uint32_t sum;
+	std::memcpy(&sum, in + 20, 4);
+	if (sum != checksum(in, 20))
+		return false;
+	std::memcpy(&h.offset, in, 8);
+	std::memcpy(&h.rawSize, in + 8, 4);
+	std::memcpy(&h.storedSize, in + 12, 4);
+	std::memcpy(&h.flags, in + 16, 4);
+	return h.offset >= 0;
+}
+
+//Checks checksum of data of record whose header was read at [offset], truncation records have no data
+//Header is written together with data, but concurrent reader can see it before data is complete
+bool validData(sqlite3_file* file, const RecordHeader& h, sqlite3_int64 offset, std::string& buffer)
+{
+	if (h.flags & flagTruncate)
+		return true;
+	buffer.resize(h.storedSize + trailerSize);
+	if (file->pMethods->xRead(file, &buffer[0], static_cast<int>(buffer.size()), offset + headerSize) != SQLITE_OK)
+		return false;
+	uint32_t sum;
+	std::memcpy(&sum, buffer.data() + h.storedSize, 4);
+	return sum == checksum(buffer.data(), h.storedSize);
+}
+
+//Location of newest record of one block of logical file
+struct Block
+{
+	sqlite3_int64 fileOffset;
+	uint32_t rawSize;
+	uint32_t storedSize;
+	bool compressed;
+};
+
+typedef std::map<sqlite3_int64, Block> BlockIndex;
+
+//Removes blocks overlapping logical range [start, end)
+void eraseRange(BlockIndex& index, sqlite3_int64 start, sqlite3_int64 end)
+{
+	auto it = index.upper_bound(start);
+	if (it != index.begin() && std::prev(it)->first + std::prev(it)->second.rawSize > start)
+		--it;
+	while (it != index.end() && it->first < end)
+		it = index.erase(it);
+}
+
+//Applies record to index and logical size, same function is used when writing and when reading file
+void applyRecord(BlockIndex& index, sqlite3_int64& logicalSize, const RecordHeader& h, sqlite3_int64 fileOffset)
+{
+	if (h.flags & flagTruncate) {
+		index.erase(index.lower_bound(h.offset), index.end());
+		logicalSize = h.offset;
+	}
+	else {
+		eraseRange(index, h.offset, h.offset + h.rawSize);
+		index[h.offset] = Block{ fileOffset, h.rawSize, h.storedSize, (h.flags & flagCompressed) != 0 };
+		logicalSize = std::max(logicalSize, h.offset + static_cast<sqlite3_int64>(h.rawSize));
+	}
+}
+
+//------------------------VFS state-----------------------------//
+
+//Registered VFS, pAppData of sqlite3_vfs points to it
+struct CompressVfs
+{
+	sqlite3_vfs vfs;
+	std::string name;
+	sqlite3_vfs* real;
+	std::shared_ptr<PageCodec> codec;
+};
+
+std::mutex registryMutex;
+std::map<std::string, std::unique_ptr<CompressVfs>> registry;
+
+//Count of open main database files by full path, compact() refuses files open in this process
+std::map<std::string, int> openDatabases;
+
+CompressVfs* owner(sqlite3_vfs* vfs)
+{
+	return static_cast<CompressVfs*>(vfs->pAppData);
+}
+
+//Opened file, file of wrapped VFS is allocated right behind this structure
+//Only main database file is compressed, for other files only real file is used
+struct CompressFile
+{
+	sqlite3_file base;
+	CompressVfs* vfs;
+
+	//Compression state of main database file, null for other files
+	struct State
+	{
+		BlockIndex index;
+		sqlite3_int64 logicalSize = 0;
+		//End of last valid record, new records are appended here
+		sqlite3_int64 end = 0;
+		//Last decompressed block, used for reads smaller than block
+		std::vector<char> cache;
+		sqlite3_int64 cacheStart = -1;
+		//Buffers reused between calls
+		std::string stored;
+		std::vector<char> scratch;
+		//Key of file in openDatabases
+		std::string path;
+	};
+	State* state;
+
+	sqlite3_file* real()
+	{
+		return reinterpret_cast<sqlite3_file*>(this + 1);
+	}
+
+	int realRead(void* buffer, int amount, sqlite3_int64 offset)
+	{
+		return real()->pMethods->xRead(real(), buffer, amount, offset);
+	}
+
+	int realWrite(const void* buffer, int amount, sqlite3_int64 offset)
+	{
+		return real()->pMethods->xWrite(real(), buffer, amount, offset);
+	}
+
+	//Reads records appended by other connections since last call
+	int refresh()
+	{
+		sqlite3_int64 physical;
+		int rc = real()->pMethods->xFileSize(real(), &physical);
+		if (rc != SQLITE_OK || physical == state->end)
+			return rc;
+
+		//File was replaced or truncated, read it again from start
+		if (physical < state->end) {
+			state->index.clear();
+			state->logicalSize = 0;
+			state->end = 0;
+		}
+		state->cacheStart = -1;
+
+		if (state->end == 0) {
+			if (physical == 0)
+				return SQLITE_OK;
+			char magic[sizeof(fileMagic)];
+			if (physical < static_cast<sqlite3_int64>(sizeof(fileMagic))
+				|| realRead(magic, sizeof(magic), 0) != SQLITE_OK
+				|| std::memcmp(magic, fileMagic, sizeof(magic)) != 0)
+				return SQLITE_NOTADB;
+			state->end = sizeof(fileMagic);
+		}
+
+		//Stops at first incomplete record, it is either being written or was torn by crash
+		//Data is checked too, so record is not indexed before its writer finished it
+		char buffer[headerSize];
+		while (state->end + headerSize <= physical) {
+			RecordHeader h;
+			if (realRead(buffer, headerSize, state->end) != SQLITE_OK || !decodeHeader(buffer, h))
+				break;
+			sqlite3_int64 next = state->end + headerSize + h.storedSize + ((h.flags & flagTruncate) ? 0 : trailerSize);
+			if (next > physical || !validData(real(), h, state->end, state->stored))
+				break;
+			applyRecord(state->index, state->logicalSize, h, state->end + headerSize);
+			state->end = next;
+		}
+		return SQLITE_OK;
+	}
+
+	//Decompresses whole block into [out] of block raw size
+	int decode(const Block& block, char* out)
+	{
+		state->stored.resize(block.storedSize + trailerSize);
+		int rc = realRead(&state->stored[0], block.storedSize + trailerSize, block.fileOffset);
+		if (rc != SQLITE_OK)
+			return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_CORRUPT : rc;
+
+		uint32_t sum;
+		std::memcpy(&sum, state->stored.data() + block.storedSize, 4);
+		if (sum != checksum(state->stored.data(), block.storedSize))
+			return SQLITE_CORRUPT;
+
+		if (!block.compressed) {
+			std::memcpy(out, state->stored.data(), block.rawSize);
+			return SQLITE_OK;
+		}
+		return vfs->codec->decompress(state->stored.data(), block.storedSize, out, block.rawSize) ? SQLITE_OK : SQLITE_CORRUPT;
+	}
+
+	int read(char* out, int amount, sqlite3_int64 offset)
+	{
+		const sqlite3_int64 endPos = offset + amount;
+		sqlite3_int64 pos = offset;
+		bool isShort = false;
+
+		while (pos < endPos) {
+			auto next = state->index.upper_bound(pos);
+			if (pos < state->logicalSize && next != state->index.begin()
+				&& std::prev(next)->first + std::prev(next)->second.rawSize > pos) {
+				const sqlite3_int64 start = std::prev(next)->first;
+				const Block& block = std::prev(next)->second;
+
+				//Whole block requested, usual case of page read
+				if (pos == start && endPos - pos >= block.rawSize) {
+					int rc = decode(block, out + (pos - offset));
+					if (rc != SQLITE_OK)
+						return rc;
+					pos += block.rawSize;
+					continue;
+				}
+
+				if (state->cacheStart != start) {
+					state->cacheStart = -1;
+					state->cache.resize(block.rawSize);
+					int rc = decode(block, state->cache.data());
+					if (rc != SQLITE_OK)
+						return rc;
+					state->cacheStart = start;
+				}
+				sqlite3_int64 until = std::min(endPos, start + static_cast<sqlite3_int64>(block.rawSize));
+				std::memcpy(out + (pos - offset), state->cache.data() + (pos - start), until - pos);
+				pos = until;
+			}
+			else {
+				//Hole or data behind end of file is read as zeros
+				sqlite3_int64 until = next == state->index.end() ? endPos : std::min(endPos, next->first);
+				if (until <= pos)
+					until = endPos;
+				std::memset(out + (pos - offset), 0, until - pos);
+				if (until > state->logicalSize)
+					isShort = true;
+				pos = until;
+			}
+		}
+		return isShort ? SQLITE_IOERR_SHORT_READ : SQLITE_OK;
+	}
+
+	//Appends record to end of file and applies it to index
+	int append(RecordHeader h, const char* data)
+	{
+		if (state->end == 0) {
+			int rc = realWrite(fileMagic, sizeof(fileMagic), 0);
+			if (rc != SQLITE_OK)
+				return rc;
+			state->end = sizeof(fileMagic);
+		}
+
+		const bool truncate = (h.flags & flagTruncate) != 0;
+		if (!truncate) {
+			vfs->codec->compress(data, h.rawSize, state->stored);
+			if (state->stored.size() < h.rawSize)
+				h.flags |= flagCompressed;
+			else
+				state->stored.assign(data, h.rawSize);
+			h.storedSize = static_cast<uint32_t>(state->stored.size());
+		}
+
+		//Header, data and checksum are written by one call
+		state->scratch.resize(headerSize + (truncate ? 0 : h.storedSize + trailerSize));
+		encodeHeader(h, state->scratch.data());
+		if (!truncate) {
+			std::memcpy(state->scratch.data() + headerSize, state->stored.data(), h.storedSize);
+			uint32_t sum = checksum(state->stored.data(), h.storedSize);
+			std::memcpy(state->scratch.data() + headerSize + h.storedSize, &sum, 4);
+		}
+
+		int rc = realWrite(state->scratch.data(), static_cast<int>(state->scratch.size()), state->end);
+		if (rc != SQLITE_OK)
+			return rc;
+
+		applyRecord(state->index, state->logicalSize, h, state->end + headerSize);
+		state->end += state->scratch.size();
+		state->cacheStart = -1;
+		return SQLITE_OK;
+	}
+
+	int write(const char* data, int amount, sqlite3_int64 offset)
+	{
+		sqlite3_int64 start = offset;
+		sqlite3_int64 end = offset + amount;
+
+		//Writes which do not match existing block (e.g. after change of page size)
+		//are merged with overlapped blocks into one new block
+		auto it = state->index.upper_bound(start);
+		if (it != state->index.begin() && std::prev(it)->first + std::prev(it)->second.rawSize > start)
+			--it;
+		bool exact = it == state->index.end() || it->first >= end
+			|| (it->first == start && it->second.rawSize == static_cast<uint32_t>(amount)
+				&& (std::next(it) == state->index.end() || std::next(it)->first >= end));
+		if (exact)
+			return append(RecordHeader{ offset, static_cast<uint32_t>(amount), 0, 0 }, data);
+
+		start = std::min(start, it->first);
+		for (; it != state->index.end() && it->first < end; ++it)
+			end = std::max(end, it->first + static_cast<sqlite3_int64>(it->second.rawSize));
+
+		std::vector<char> merged(static_cast<size_t>(end - start));
+		int rc = read(merged.data(), static_cast<int>(merged.size()), start);
+		if (rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ)
+			return rc;
+		std::memcpy(merged.data() + (offset - start), data, amount);
+		return append(RecordHeader{ start, static_cast<uint32_t>(merged.size()), 0, 0 }, merged.data());
+	}
+
+	int truncate(sqlite3_int64 size)
+	{
+		//Block crossing new end is rewritten shorter so its tail is not visible after later growth
+		std::vector<char> tail;
+		sqlite3_int64 tailStart = -1;
+		auto it = state->index.lower_bound(size);
+		if (it != state->index.begin() && std::prev(it)->first + std::prev(it)->second.rawSize > size) {
+			tailStart = std::prev(it)->first;
+			tail.resize(static_cast<size_t>(size - tailStart));
+			int rc = read(tail.data(), static_cast<int>(tail.size()), tailStart);
+			if (rc != SQLITE_OK)
+				return rc;
+		}
+
+		int rc = append(RecordHeader{ size, 0, 0, flagTruncate }, nullptr);
+		if (rc == SQLITE_OK && tailStart >= 0 && !tail.empty())
+			rc = append(RecordHeader{ tailStart, static_cast<uint32_t>(tail.size()), 0, 0 }, tail.data());
+		return rc;
+	}
+};
+
+CompressFile* compressFile(sqlite3_file* file)
+{
+	return reinterpret_cast<CompressFile*>(file);
+}
+
+sqlite3_file* realFile(sqlite3_file* file)
+{
+	return compressFile(file)->real();
+}
+
+//------------------------File methods-----------------------------//
+
+int cmpClose(sqlite3_file* file)
+{
+	CompressFile* f = compressFile(file);
+	if (f->state && !f->state->path.empty()) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (--openDatabases[f->state->path] == 0)
+			openDatabases.erase(f->state->path);
+	}
+	delete f->state;
+	f->state = nullptr;
+	return f->real()->pMethods ? f->real()->pMethods->xClose(f->real()) : SQLITE_OK;
+}
+
+int cmpRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset)
+{
+	CompressFile* f = compressFile(file);
+	if (!f->state)
+		return f->realRead(buffer, amount, offset);
+
+	int rc = f->refresh();
+	return rc == SQLITE_OK ? f->read(static_cast<char*>(buffer), amount, offset) : rc;
+}
+
+int cmpWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset)
+{
+	CompressFile* f = compressFile(file);
+	if (!f->state)
+		return f->realWrite(buffer, amount, offset);
+
+	int rc = f->refresh();
+	return rc == SQLITE_OK ? f->write(static_cast<const char*>(buffer), amount, offset) : rc;
+}
+
+int cmpTruncate(sqlite3_file* file, sqlite3_int64 size)
+{
+	CompressFile* f = compressFile(file);
+	if (!f->state)
+		return f->real()->pMethods->xTruncate(f->real(), size);
+
+	int rc = f->refresh();
+	if (rc != SQLITE_OK || size >= f->state->logicalSize)
+		return rc;
+	return f->truncate(size);
+}
+
+int cmpSync(sqlite3_file* file, int flags)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xSync(real, flags);
+}
+
+int cmpFileSize(sqlite3_file* file, sqlite3_int64* size)
+{
+	CompressFile* f = compressFile(file);
+	if (!f->state)
+		return f->real()->pMethods->xFileSize(f->real(), size);
+
+	int rc = f->refresh();
+	*size = f->state->logicalSize;
+	return rc;
+}
+
+int cmpLock(sqlite3_file* file, int lock)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xLock(real, lock);
+}
+
+int cmpUnlock(sqlite3_file* file, int lock)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xUnlock(real, lock);
+}
+
+int cmpCheckReservedLock(sqlite3_file* file, int* out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int cmpFileControl(sqlite3_file* file, int op, void* arg)
+{
+	CompressFile* f = compressFile(file);
+
+	//Size hints and chunk size would grow physical file, which is not layout of logical file
+	if (f->state && (op == SQLITE_FCNTL_SIZE_HINT || op == SQLITE_FCNTL_CHUNK_SIZE))
+		return SQLITE_OK;
+
+	int rc = f->real()->pMethods->xFileControl(f->real(), op, arg);
+	if (op == SQLITE_FCNTL_VFSNAME && rc == SQLITE_OK)
+		*static_cast<char**>(arg) = sqlite3_mprintf("%s/%z", f->vfs->name.c_str(), *static_cast<char**>(arg));
+	return rc;
+}
+
+int cmpSectorSize(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xSectorSize(real);
+}
+
+int cmpDeviceCharacteristics(sqlite3_file* file)
+{
+	CompressFile* f = compressFile(file);
+	int rval = f->real()->pMethods->xDeviceCharacteristics(f->real());
+	//Pages are not written in place
+	if (f->state)
+		rval &= ~SQLITE_IOCAP_POWERSAFE_OVERWRITE;
+	return rval;
+}
+
+int cmpShmMap(sqlite3_file* file, int page, int pageSize, int extend, void volatile** out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmMap(real, page, pageSize, extend, out) : SQLITE_IOERR_SHMMAP;
+}
+
+int cmpShmLock(sqlite3_file* file, int offset, int n, int flags)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmLock(real, offset, n, flags) : SQLITE_IOERR_SHMLOCK;
+}
+
+void cmpShmBarrier(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	if (real->pMethods->iVersion >= 2)
+		real->pMethods->xShmBarrier(real);
+}
+
+int cmpShmUnmap(sqlite3_file* file, int deleteFlag)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmUnmap(real, deleteFlag) : SQLITE_OK;
+}
+
+//Memory mapping of compressed file is not possible, SQLite falls back to xRead
+int cmpFetch(sqlite3_file*, sqlite3_int64, int, void** out)
+{
+	*out = nullptr;
+	return SQLITE_OK;
+}
+
+int cmpUnfetch(sqlite3_file*, sqlite3_int64, void*)
+{
+	return SQLITE_OK;
+}
+
+const sqlite3_io_methods cmpMethods = {
+	3,
+	cmpClose,
+	cmpRead,
+	cmpWrite,
+	cmpTruncate,
+	cmpSync,
+	cmpFileSize,
+	cmpLock,
+	cmpUnlock,
+	cmpCheckReservedLock,
+	cmpFileControl,
+	cmpSectorSize,
+	cmpDeviceCharacteristics,
+	cmpShmMap,
+	cmpShmLock,
+	cmpShmBarrier,
+	cmpShmUnmap,
+	cmpFetch,
+	cmpUnfetch
+};
+
+//------------------------VFS methods-----------------------------//
+
+int cmpOpen(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags)
+{
+	CompressFile* f = compressFile(file);
+	f->base.pMethods = nullptr;
+	f->vfs = owner(vfs);
+	f->state = nullptr;
+
+	sqlite3_vfs* real = f->vfs->real;
+	int rc = real->xOpen(real, name, f->real(), flags, outFlags);
+	if (!f->real()->pMethods)
+		return rc;
+	f->base.pMethods = &cmpMethods;
+
+	if (rc == SQLITE_OK && (flags & SQLITE_OPEN_MAIN_DB)) {
+		f->state = new (std::nothrow) CompressFile::State();
+		rc = f->state ? f->refresh() : SQLITE_NOMEM;
+		if (rc == SQLITE_OK && name) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			f->state->path = name;
+			++openDatabases[name];
+		}
+		if (rc != SQLITE_OK) {
+			cmpClose(file);
+			f->base.pMethods = nullptr;
+		}
+	}
+	return rc;
+}
+
+int cmpDelete(sqlite3_vfs* vfs, const char* name, int syncDir)
+{
+	return owner(vfs)->real->xDelete(owner(vfs)->real, name, syncDir);
+}
+
+int cmpAccess(sqlite3_vfs* vfs, const char* name, int flags, int* out)
+{
+	return owner(vfs)->real->xAccess(owner(vfs)->real, name, flags, out);
+}
+
+int cmpFullPathname(sqlite3_vfs* vfs, const char* name, int size, char* out)
+{
+	return owner(vfs)->real->xFullPathname(owner(vfs)->real, name, size, out);
+}
+
+void* cmpDlOpen(sqlite3_vfs* vfs, const char* name)
+{
+	return owner(vfs)->real->xDlOpen(owner(vfs)->real, name);
+}
+
+void cmpDlError(sqlite3_vfs* vfs, int size, char* out)
+{
+	owner(vfs)->real->xDlError(owner(vfs)->real, size, out);
+}
+
+void (*cmpDlSym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void)
+{
+	return owner(vfs)->real->xDlSym(owner(vfs)->real, handle, symbol);
+}
+
+void cmpDlClose(sqlite3_vfs* vfs, void* handle)
+{
+	owner(vfs)->real->xDlClose(owner(vfs)->real, handle);
+}
+
+int cmpRandomness(sqlite3_vfs* vfs, int size, char* out)
+{
+	return owner(vfs)->real->xRandomness(owner(vfs)->real, size, out);
+}
+
+int cmpSleep(sqlite3_vfs* vfs, int micros)
+{
+	return owner(vfs)->real->xSleep(owner(vfs)->real, micros);
+}
+
+int cmpCurrentTime(sqlite3_vfs* vfs, double* out)
+{
+	return owner(vfs)->real->xCurrentTime(owner(vfs)->real, out);
+}
+
+int cmpGetLastError(sqlite3_vfs* vfs, int size, char* out)
+{
+	sqlite3_vfs* real = owner(vfs)->real;
+	return real->xGetLastError ? real->xGetLastError(real, size, out) : 0;
+}
+
+int cmpCurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* out)
+{
+	return owner(vfs)->real->xCurrentTimeInt64(owner(vfs)->real, out);
+}
+
+//------------------------LZ block format-----------------------------//
+
+const size_t minMatch = 4;
+//End of block rules of LZ4: last 5 bytes are literals and last match starts at least 12 bytes before end
+const size_t lastLiterals = 5;
+const size_t matchStartLimit = 12;
+const int hashBits = 12;
+
+uint32_t read32(const char* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, 4);
+	return v;
+}
+
+uint32_t hash4(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - hashBits);
+}
+
+//Writes length extension bytes of LZ4 sequence
+void putLength(std::string& out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		out += static_cast<char>(255);
+	out += static_cast<char>(length);
+}
+
+void putSequence(std::string& out, const char* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	const size_t matchCode = matchLength ? matchLength - minMatch : 0;
+	out += static_cast<char>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+	if (literalCount >= 15)
+		putLength(out, literalCount - 15);
+	out.append(literals, literalCount);
+	if (matchLength) {
+		out += static_cast<char>(offset & 0xFF);
+		out += static_cast<char>(offset >> 8);
+		if (matchCode >= 15)
+			putLength(out, matchCode - 15);
+	}
+}
+
+} // namespace
+
+//------------------------LzPageCodec-----------------------------//
+
+void LzPageCodec::compress(const char* in, size_t size, std::string& out) const
+{
+	out.clear();
+	int64_t table[1 << hashBits];
+	std::fill(std::begin(table), std::end(table), -1);
+
+	size_t anchor = 0;
+	size_t pos = 0;
+	//Blocks shorter than 13 bytes are only literals
+	const size_t matchEnd = size > matchStartLimit ? size - lastLiterals : 0;
+	while (size > matchStartLimit && pos + matchStartLimit <= size) {
+		const uint32_t value = read32(in + pos);
+		const uint32_t h = hash4(value);
+		const int64_t ref = table[h];
+		table[h] = static_cast<int64_t>(pos);
+
+		if (ref >= 0 && pos - ref <= 0xFFFF && read32(in + ref) == value) {
+			size_t length = minMatch;
+			while (pos + length < matchEnd && in[ref + length] == in[pos + length])
+				++length;
+			putSequence(out, in + anchor, pos - anchor, pos - ref, length);
+			pos += length;
+			anchor = pos;
+			//Do not bother when output is already larger than input
+			if (out.size() >= size)
+				return;
+		}
+		else
+			++pos;
+	}
+	putSequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+//End of block rules are not checked, blocks written before compress followed them stay readable
+bool LzPageCodec::decompress(const char* in, size_t size, char* out, size_t rawSize) const
+{
+	const unsigned char* ip = reinterpret_cast<const unsigned char*>(in);
+	const unsigned char* const ipEnd = ip + size;
+	size_t op = 0;
+
+	auto readLength = [&](size_t length) -> size_t {
+		unsigned char b;
+		do {
+			if (ip == ipEnd)
+				return SIZE_MAX;
+			b = *ip++;
+			length += b;
+		} while (b == 255);
+		return length;
+	};
+
+	while (ip < ipEnd) {
+		const unsigned char token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && (literals = readLength(literals)) == SIZE_MAX)
+			return false;
+		if (literals > static_cast<size_t>(ipEnd - ip) || literals > rawSize - op)
+			return false;
+		std::memcpy(out + op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		//Last sequence has only literals
+		if (ip == ipEnd)
+			break;
+
+		if (ipEnd - ip < 2)
+			return false;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		size_t length = token & 15;
+		if (length == 15 && (length = readLength(length)) == SIZE_MAX)
+			return false;
+		length += minMatch;
+		if (offset == 0 || offset > op || length > rawSize - op)
+			return false;
+
+		//Match can overlap output being written so it is copied byte by byte
+		for (size_t i = 0; i < length; ++i, ++op)
+			out[op] = out[op - offset];
+	}
+	return op == rawSize;
+}
+
+//------------------------CompressedVfs-----------------------------//
+
+const char* const CompressedVfs::defaultName = "mcompress";
+
+const char* CompressedVfs::install(const char* name, std::shared_ptr<PageCodec> codec)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	auto it = registry.find(name);
+	if (it != registry.end())
+		return it->second->name.c_str();
+
+	sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+	if (!real)
+		throw SQLite3Error("There is no default VFS to wrap");
+
+	std::unique_ptr<CompressVfs> v(new CompressVfs());
+	v->name = name;
+	v->real = real;
+	v->codec = codec ? codec : std::make_shared<LzPageCodec>();
+
+	sqlite3_vfs& vfs = v->vfs;
+	vfs.iVersion = 2;
+	vfs.szOsFile = sizeof(CompressFile) + real->szOsFile;
+	vfs.mxPathname = real->mxPathname;
+	vfs.zName = v->name.c_str();
+	vfs.pAppData = v.get();
+	vfs.xOpen = cmpOpen;
+	vfs.xDelete = cmpDelete;
+	vfs.xAccess = cmpAccess;
+	vfs.xFullPathname = cmpFullPathname;
+	vfs.xDlOpen = real->xDlOpen ? cmpDlOpen : nullptr;
+	vfs.xDlError = real->xDlError ? cmpDlError : nullptr;
+	vfs.xDlSym = real->xDlSym ? cmpDlSym : nullptr;
+	vfs.xDlClose = real->xDlClose ? cmpDlClose : nullptr;
+	vfs.xRandomness = cmpRandomness;
+	vfs.xSleep = cmpSleep;
+	vfs.xCurrentTime = cmpCurrentTime;
+	vfs.xGetLastError = cmpGetLastError;
+	vfs.xCurrentTimeInt64 = real->iVersion >= 2 ? cmpCurrentTimeInt64 : nullptr;
+	if (!vfs.xCurrentTimeInt64)
+		vfs.iVersion = 1;
+
+	int rc = sqlite3_vfs_register(&vfs, 0);
+	if (rc != SQLITE_OK)
+		throw SQLite3Error(SQLite3ErrorInfo::fromCode(rc, std::string("VFS can't be registered: ") + sqlite3_errstr(rc)));
+	return registry.emplace(v->name, std::move(v)).first->second->name.c_str();
+}
+
+namespace {
+
+//Opened file of default VFS, closed by destructor
+class RealFile
+{
+private:
+	std::vector<char> storage;
+	sqlite3_file* file;
+	bool opened;
+public:
+	explicit RealFile(sqlite3_vfs* vfs)
+		:storage(vfs->szOsFile)
+		,file(reinterpret_cast<sqlite3_file*>(storage.data()))
+		,opened(false)
+	{}
+
+	~RealFile() {
+		if (opened) {
+			file->pMethods->xUnlock(file, SQLITE_LOCK_NONE);
+			file->pMethods->xClose(file);
+		}
+	}
+
+	RealFile(const RealFile&) = delete;
+	RealFile& operator=(const RealFile&) = delete;
+
+	int open(sqlite3_vfs* vfs, const char* path, int flags) {
+		int outFlags = 0;
+		const int rc = vfs->xOpen(vfs, path, file, flags, &outFlags);
+		opened = file->pMethods != nullptr;
+		return rc;
+	}
+
+	sqlite3_file* operator->() const {
+		return file;
+	}
+
+	sqlite3_file* get() const {
+		return file;
+	}
+};
+
+[[noreturn]] void compactionFailed(int rc, const std::string& message, const std::string& path)
+{
+	throw SQLite3Error(SQLite3ErrorInfo::fromCode(rc, message + ": " + path));
+}
+
+//Journal whose header is not zeroed or WAL with frames means database was not closed cleanly or is open
+bool hasPendingLog(const std::string& path)
+{
+	struct stat st;
+	if (stat((path + "-wal").c_str(), &st) == 0 && st.st_size > 0)
+		return true;
+	const int fd = ::open((path + "-journal").c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	char first = 0;
+	const bool hot = ::pread(fd, &first, 1, 0) == 1 && first != 0;
+	::close(fd);
+	return hot;
+}
+
+bool writeAll(int fd, const char* data, size_t size)
+{
+	while (size > 0) {
+		const ssize_t written = ::write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+//Makes rename of file in [path] durable
+bool syncDirectory(const std::string& path)
+{
+	const size_t slash = path.rfind('/');
+	const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	const bool synced = ::fsync(fd) == 0;
+	::close(fd);
+	return synced;
+}
+
+}
+
+sqlite3_int64 CompressedVfs::compact(const std::string& path, double minDeadShare)
+{
+	sqlite3_vfs* vfs = sqlite3_vfs_find(nullptr);
+	if (!vfs)
+		throw SQLite3Error("There is no default VFS");
+	std::vector<char> fullPath(vfs->mxPathname + 1);
+	int rc = vfs->xFullPathname(vfs, path.c_str(), static_cast<int>(fullPath.size()), fullPath.data());
+	if (rc != SQLITE_OK)
+		compactionFailed(rc, "Can't resolve path of file for compaction", path);
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (openDatabases.count(fullPath.data()))
+			compactionFailed(SQLITE_BUSY, "Database is open by connection of this process", path);
+	}
+	if (hasPendingLog(path))
+		compactionFailed(SQLITE_BUSY, "Database has journal or WAL, open and close it before compaction", path);
+
+	//Exclusive lock of SQLite keeps other processes out of database for the whole compaction
+	RealFile in(vfs);
+	rc = in.open(vfs, fullPath.data(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_MAIN_DB);
+	if (rc != SQLITE_OK)
+		compactionFailed(rc, "Can't open file for compaction", path);
+	if ((rc = in->pMethods->xLock(in.get(), SQLITE_LOCK_SHARED)) != SQLITE_OK
+		|| (rc = in->pMethods->xLock(in.get(), SQLITE_LOCK_EXCLUSIVE)) != SQLITE_OK)
+		compactionFailed(rc, "Database is in use", path);
+	//Journal could be created before lock was taken
+	if (hasPendingLog(path))
+		compactionFailed(SQLITE_BUSY, "Database has journal or WAL, open and close it before compaction", path);
+
+	auto readAt = [&](char* out, size_t size, sqlite3_int64 offset) {
+		return in->pMethods->xRead(in.get(), out, static_cast<int>(size), offset) == SQLITE_OK;
+	};
+
+	sqlite3_int64 physical = 0;
+	char magic[sizeof(fileMagic)];
+	if (in->pMethods->xFileSize(in.get(), &physical) != SQLITE_OK
+		|| !readAt(magic, sizeof(magic), 0) || std::memcmp(magic, fileMagic, sizeof(magic)) != 0)
+		compactionFailed(SQLITE_NOTADB, "File is not compressed database", path);
+
+	//Same replay as in refresh, stored bytes are copied without recompression
+	BlockIndex index;
+	std::string data;
+	sqlite3_int64 logicalSize = 0;
+	sqlite3_int64 pos = sizeof(fileMagic);
+	char header[headerSize];
+	while (pos + headerSize <= physical) {
+		RecordHeader h;
+		if (!readAt(header, headerSize, pos) || !decodeHeader(header, h))
+			break;
+		sqlite3_int64 next = pos + headerSize + h.storedSize + ((h.flags & flagTruncate) ? 0 : trailerSize);
+		if (next > physical || !validData(in.get(), h, pos, data))
+			break;
+		applyRecord(index, logicalSize, h, pos + headerSize);
+		pos = next;
+	}
+
+	//Logical size can end in hole left by truncation
+	const bool hole = !index.empty() && index.rbegin()->first + index.rbegin()->second.rawSize != logicalSize;
+	sqlite3_int64 compacted = sizeof(fileMagic) + (hole ? headerSize : 0);
+	for (auto& entry : index)
+		compacted += headerSize + entry.second.storedSize + trailerSize;
+	if (physical - compacted <= 0 || physical - compacted < minDeadShare * physical)
+		return 0;
+
+	const std::string tmpPath = path + "-compact";
+	const int out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0)
+		compactionFailed(SQLITE_CANTOPEN, "Can't create compacted file", path);
+	bool written = writeAll(out, fileMagic, sizeof(fileMagic));
+
+	std::vector<char> stored;
+	for (auto it = index.begin(); written && it != index.end(); ++it) {
+		const Block& block = it->second;
+		RecordHeader h{ it->first, block.rawSize, block.storedSize, block.compressed ? flagCompressed : 0 };
+		encodeHeader(h, header);
+		stored.resize(block.storedSize + trailerSize);
+		written = readAt(stored.data(), stored.size(), block.fileOffset)
+			&& writeAll(out, header, headerSize) && writeAll(out, stored.data(), stored.size());
+	}
+	if (written && hole) {
+		RecordHeader h{ logicalSize, 0, 0, flagTruncate };
+		encodeHeader(h, header);
+		written = writeAll(out, header, headerSize);
+	}
+	//Compacted file has to be on disk before it replaces original, and the rename has to be on disk before return
+	written = written && ::fsync(out) == 0;
+	written = ::close(out) == 0 && written;
+	if (!written) {
+		std::remove(tmpPath.c_str());
+		compactionFailed(SQLITE_IOERR, "Compaction of file failed", path);
+	}
+
+	if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		compactionFailed(SQLITE_IOERR, "Compacted file can't replace original", path);
+	}
+	if (!syncDirectory(path))
+		compactionFailed(SQLITE_IOERR_DIR_FSYNC, "Directory of compacted file can't be synced", path);
+	return physical - compacted;
+}
@@ -0,0 +1,67 @@
+#ifndef MSQLite3CompressVfsH
+#define MSQLite3CompressVfsH
+#include "MSQLite3.h"
+#include <memory>
+
+//PageCodec is interface of compression algorithm used by CompressedVfs
+//Implementations have to be thread safe, one codec is shared by all connections using the VFS
+class PageCodec
+{
+public:
+	virtual ~PageCodec() = default;
+
+	//Compresses [size] bytes from [in] and stores result into [out]
+	//Page is stored uncompressed when result is not smaller than input
+	virtual void compress(const char* in, size_t size, std::string& out) const = 0;
+
+	//Decompresses [size] bytes from [in] into [out] which has room for [rawSize] bytes
+	//Returns false if input is corrupted or does not decompress to exactly [rawSize] bytes
+	virtual bool decompress(const char* in, size_t size, char* out, size_t rawSize) const = 0;
+};
+
+//Bundled byte oriented LZ77 codec using LZ4 block format
+//Blocks follow end of block rules of LZ4, so they can be decoded by LZ4_decompress_safe
+//Fast to decompress, good for text heavy pages
+class LzPageCodec : public PageCodec
+{
+public:
+	void compress(const char* in, size_t size, std::string& out) const override;
+	bool decompress(const char* in, size_t size, char* out, size_t rawSize) const override;
+};
+
+//CompressedVfs is VFS which stores every page of main database file compressed
+//Journal, WAL and temporary files are passed to default VFS unchanged
+//Main database file is log of checksummed page records, newest record of page wins
+//and index of pages is kept in memory, so page read is one pread and one decompression
+//Overwritten pages leave dead records in file, compact() rewrites file with live pages only,
+//ordered by page number so full scans read file sequentially
+//Space is not reclaimed while database is open: every page write, including checkpoint of WAL, appends
+//a record, so file of frequently updated database keeps growing until compact() runs on closed database,
+//e.g. at start of application before first connection is opened
+//Database created by this VFS can be opened only by this VFS with the same codec
+//example
+/*
+	SQLite3 db("data.db", nullptr, CompressedVfs::install());
+*/
+class CompressedVfs
+{
+public:
+	//Name of VFS registered with LzPageCodec by install() without parameters
+	static const char* const defaultName;
+
+	//Registers VFS under given name using given codec, LzPageCodec is used if codec is null
+	//Installing already installed name only returns the name, codec is not changed
+	//Returns name of VFS so it can be passed directly to SQLite3 constructor
+	static const char* install(const char* name = defaultName, std::shared_ptr<PageCodec> codec = nullptr);
+
+	//Rewrites database file so it contains only live pages in order
+	//Compacted file is synced and replaces original by rename, directory is synced after it
+	//No connection may have the database open during compaction, it fails with SQLITE_BUSY when connection
+	//of this process has it open, other process holds lock of it or journal or WAL was left behind,
+	//connections of other processes which have database open without lock are not detected
+	//Compaction is skipped if dead records take less than [minDeadShare] of file
+	//Returns count of bytes saved, 0 if compaction was skipped
+	static sqlite3_int64 compact(const std::string& path, double minDeadShare = 0);
+};
+
+#endif
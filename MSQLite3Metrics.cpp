@@ -0,0 +1,258 @@
+#include "MSQLite3Metrics.h"
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+typedef std::vector<std::pair<std::string, SQLite3Metrics>> Snapshots;
+
+//Names of primary result codes, used as values of label code
+const char* codeName(int code)
+{
+	static const char* const names[] = {
+		"SQLITE_OK", "SQLITE_ERROR", "SQLITE_INTERNAL", "SQLITE_PERM", "SQLITE_ABORT", "SQLITE_BUSY", "SQLITE_LOCKED",
+		"SQLITE_NOMEM", "SQLITE_READONLY", "SQLITE_INTERRUPT", "SQLITE_IOERR", "SQLITE_CORRUPT", "SQLITE_NOTFOUND",
+		"SQLITE_FULL", "SQLITE_CANTOPEN", "SQLITE_PROTOCOL", "SQLITE_EMPTY", "SQLITE_SCHEMA", "SQLITE_TOOBIG",
+		"SQLITE_CONSTRAINT", "SQLITE_MISMATCH", "SQLITE_MISUSE", "SQLITE_NOLFS", "SQLITE_AUTH", "SQLITE_FORMAT",
+		"SQLITE_RANGE", "SQLITE_NOTADB", "SQLITE_NOTICE", "SQLITE_WARNING"
+	};
+	return code < static_cast<int>(sizeof(names) / sizeof(names[0])) ? names[code] : nullptr;
+}
+
+//Label values escape backslash, double quote and new line
+void appendLabel(std::string& out, const char* name, const std::string& value)
+{
+	out += name;
+	out += "=\"";
+	for (char c : value) {
+		if (c == '\\')
+			out += "\\\\";
+		else if (c == '"')
+			out += "\\\"";
+		else if (c == '\n')
+			out += "\\n";
+		else
+			out += c;
+	}
+	out += '"';
+}
+
+//Writes metric family, [sample] appends samples of one connection
+template<typename F>
+void family(std::string& out, const Snapshots& snapshots, const char* name, const char* type, const char* help, F sample)
+{
+	out += "# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += "\n# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += '\n';
+	for (auto& snapshot : snapshots)
+		sample(snapshot.first, snapshot.second);
+}
+
+//Writes one sample, [suffix] is e.g. _total, [label] and [labelValue] are optional second label
+void sample(std::string& out, const char* name, const char* suffix, const std::string& db, const char* label, const char* labelValue, uint64_t value)
+{
+	out += name;
+	out += suffix;
+	out += '{';
+	appendLabel(out, "db", db);
+	if (label) {
+		out += ',';
+		appendLabel(out, label, labelValue);
+	}
+	out += "} ";
+	out += std::to_string(value);
+	out += '\n';
+}
+
+void sample(std::string& out, const char* name, const char* suffix, const std::string& db, double value)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+	out += name;
+	out += suffix;
+	out += '{';
+	appendLabel(out, "db", db);
+	out += "} ";
+	out += buffer;
+	out += '\n';
+}
+
+//Counter family with one sample per connection
+void counter(std::string& out, const Snapshots& snapshots, const char* name, const char* help, uint64_t SQLite3Metrics::* member)
+{
+	family(out, snapshots, name, "counter", help, [&](const std::string& db, const SQLite3Metrics& metrics) {
+		sample(out, name, "_total", db, nullptr, nullptr, metrics.*member);
+	});
+}
+
+void counter(std::string& out, const Snapshots& snapshots, const char* name, const char* help, uint64_t StatementStats::* member)
+{
+	family(out, snapshots, name, "counter", help, [&](const std::string& db, const SQLite3Metrics& metrics) {
+		sample(out, name, "_total", db, nullptr, nullptr, metrics.statements.*member);
+	});
+}
+
+void gauge(std::string& out, const Snapshots& snapshots, const char* name, const char* help, uint64_t SQLite3Metrics::* member)
+{
+	family(out, snapshots, name, "gauge", help, [&](const std::string& db, const SQLite3Metrics& metrics) {
+		sample(out, name, "", db, nullptr, nullptr, metrics.*member);
+	});
+}
+
+//I/O counters of InstrumentedVfs are process wide, so they are written once, labelled by kind of file and operation
+void io(std::string& out, const Snapshots& snapshots, const char* name, const char* type, const char* help, const char* suffix
+	, const std::function<void(const char* op, const IoMetrics& io, std::string& value)>& values)
+{
+	out += "# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += "\n# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += '\n';
+	if (snapshots.empty())
+		return;
+
+	const SQLite3Metrics& metrics = snapshots.front().second;
+	const std::pair<const char*, const IoMetrics*> files[] = {
+		{ "main", &metrics.mainDb }, { "wal", &metrics.wal }, { "journal", &metrics.journal }, { "other", &metrics.otherFiles }
+	};
+	for (auto& file : files)
+		for (const char* op : { "read", "write", "sync" }) {
+			std::string value;
+			values(op, *file.second, value);
+			if (value.empty())
+				continue;
+			out += name;
+			out += suffix;
+			out += '{';
+			appendLabel(out, "file", file.first);
+			out += ',';
+			appendLabel(out, "op", op);
+			out += "} ";
+			out += value;
+			out += '\n';
+		}
+}
+
+std::string seconds(std::chrono::nanoseconds time)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.9g", std::chrono::duration<double>(time).count());
+	return buffer;
+}
+
+}
+
+void MetricsRegistry::add(const std::string& name, const SQLite3& db)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	snapshots.erase(name);
+	connections[name] = &db;
+}
+
+void MetricsRegistry::update(const std::string& name, const SQLite3Metrics& metrics)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	connections.erase(name);
+	snapshots[name] = metrics;
+}
+
+void MetricsRegistry::remove(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	connections.erase(name);
+	snapshots.erase(name);
+}
+
+void MetricsRegistry::render(std::string& out) const
+{
+	Snapshots metrics;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& connection : connections)
+			metrics.emplace_back(connection.first, connection.second->metrics());
+		for (auto& snapshot : snapshots)
+			metrics.emplace_back(snapshot.first, snapshot.second);
+	}
+	//Samples of one family are sorted by name of connection
+	std::sort(metrics.begin(), metrics.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	render(out, metrics);
+}
+
+std::string MetricsRegistry::render() const
+{
+	std::string rval;
+	render(rval);
+	return rval;
+}
+
+void MetricsRegistry::render(std::string& out, const std::vector<std::pair<std::string, SQLite3Metrics>>& metrics)
+{
+	family(out, metrics, "msqlite3_queries", "counter", "Executed queries, prepared statements and raw queries",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			sample(out, "msqlite3_queries", "_total", db, "kind", "prepared", m.statements.executions);
+			sample(out, "msqlite3_queries", "_total", db, "kind", "raw", m.rawQueries);
+		});
+	counter(out, metrics, "msqlite3_rows", "Rows returned by prepared statements", &StatementStats::rows);
+	family(out, metrics, "msqlite3_errors", "counter", "Failed preparations and executions by primary result code",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			for (int code = 1; code < SQLite3Metrics::errorCodes; ++code)
+				if (m.errors[code] && codeName(code))
+					sample(out, "msqlite3_errors", "_total", db, "code", codeName(code), m.errors[code]);
+		});
+	counter(out, metrics, "msqlite3_busy", "Executions which failed with SQLITE_BUSY or SQLITE_LOCKED", &SQLite3Metrics::busy);
+	counter(out, metrics, "msqlite3_transaction_retries", "Transactions run again after busy failure", &SQLite3Metrics::transactionRetries);
+	counter(out, metrics, "msqlite3_failed_commits", "Transactions rolled back because commit in TransactionGuard failed", &SQLite3Metrics::failedCommits);
+	counter(out, metrics, "msqlite3_timeouts", "Executions stopped because their deadline passed", &SQLite3Metrics::timeouts);
+	counter(out, metrics, "msqlite3_cancellations", "Executions stopped by cancellation", &SQLite3Metrics::cancellations);
+	family(out, metrics, "msqlite3_execution_seconds", "summary", "Time of prepared statement executions run with timing",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			sample(out, "msqlite3_execution_seconds", "_sum", db, std::chrono::duration<double>(m.statements.time).count());
+			sample(out, "msqlite3_execution_seconds", "_count", db, nullptr, nullptr, m.statements.timedExecutions);
+		});
+	counter(out, metrics, "msqlite3_vm_steps", "Virtual machine operations of prepared statements", &StatementStats::vmSteps);
+	counter(out, metrics, "msqlite3_full_scan_steps", "Steps of full table scans", &StatementStats::fullScanSteps);
+	counter(out, metrics, "msqlite3_sorts", "Sorts done by prepared statements", &StatementStats::sorts);
+	counter(out, metrics, "msqlite3_auto_indexes", "Automatic indexes built by prepared statements", &StatementStats::autoIndexes);
+	family(out, metrics, "msqlite3_statement_cache_requests", "counter", "Requests of cached statements",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			sample(out, "msqlite3_statement_cache_requests", "_total", db, "result", "hit", m.statementCacheHits);
+			sample(out, "msqlite3_statement_cache_requests", "_total", db, "result", "miss", m.statementCacheMisses);
+		});
+	family(out, metrics, "msqlite3_page_cache_requests", "counter", "Page requests served by page cache of connection and read from file",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			sample(out, "msqlite3_page_cache_requests", "_total", db, "result", "hit", m.pageCacheHits);
+			sample(out, "msqlite3_page_cache_requests", "_total", db, "result", "miss", m.pageCacheMisses);
+		});
+	family(out, metrics, "msqlite3_page_cache_hit_ratio", "gauge", "Share of page requests served by page cache",
+		[&](const std::string& db, const SQLite3Metrics& m) {
+			const uint64_t requests = m.pageCacheHits + m.pageCacheMisses;
+			sample(out, "msqlite3_page_cache_hit_ratio", "", db, requests ? static_cast<double>(m.pageCacheHits) / requests : 0.0);
+		});
+	counter(out, metrics, "msqlite3_page_cache_writes", "Pages written from page cache", &SQLite3Metrics::pageCacheWrites);
+	gauge(out, metrics, "msqlite3_page_cache_bytes", "Memory used by page cache", &SQLite3Metrics::pageCacheBytes);
+	gauge(out, metrics, "msqlite3_wal_bytes", "Size of write-ahead log of main database", &SQLite3Metrics::walBytes);
+	io(out, metrics, "msqlite3_io_operations", "counter", "File operations counted by InstrumentedVfs, zero unless it is installed", "_total",
+		[](const char* op, const IoMetrics& io, std::string& value) {
+			value = std::to_string(op[0] == 'r' ? io.reads : op[0] == 'w' ? io.writes : io.syncs);
+		});
+	io(out, metrics, "msqlite3_io_bytes", "counter", "Bytes read and written through InstrumentedVfs", "_total",
+		[](const char* op, const IoMetrics& io, std::string& value) {
+			if (op[0] != 's')
+				value = std::to_string(op[0] == 'r' ? io.bytesRead : io.bytesWritten);
+		});
+	io(out, metrics, "msqlite3_io_seconds", "counter", "Time spent in file operations through InstrumentedVfs", "_total",
+		[](const char* op, const IoMetrics& io, std::string& value) {
+			value = seconds(op[0] == 'r' ? io.readTime : op[0] == 'w' ? io.writeTime : io.syncTime);
+		});
+	out += "# EOF\n";
+}
@@ -0,0 +1,52 @@
+#ifndef MSQLite3MetricsH
+#define MSQLite3MetricsH
+#include "MSQLite3.h"
+#include <map>
+#include <mutex>
+
+//MetricsRegistry renders metrics of connections in OpenMetrics text format, which is scraped by Prometheus
+//Connections are registered under name, which becomes value of label db of every sample
+//Text is rendered on demand into buffer, so it can be served by any HTTP server of application
+//I/O counters of InstrumentedVfs are process wide, they are rendered once without label db
+//example
+/*
+	MetricsRegistry registry;
+	registry.add("orders", db);
+
+	//in handler of GET /metrics, response has content type
+	//application/openmetrics-text; version=1.0.0; charset=utf-8
+	std::string body;
+	registry.render(body);
+*/
+class MetricsRegistry
+{
+private:
+	mutable std::mutex mutex;
+
+	//Connections read by every render
+	std::map<std::string, const SQLite3*> connections;
+
+	//Metrics given by update, rendered until next update
+	std::map<std::string, SQLite3Metrics> snapshots;
+public:
+	//Registers connection, its metrics are read by every following render, on thread which calls it
+	//Connection has to stay alive until it is removed. It is read under its mutex, which exists only in serialized
+	//SQLite (SQLITE_THREADSAFE=1, the default); with multi-thread SQLite update has to be used instead
+	void add(const std::string& name, const SQLite3& db);
+
+	//Stores metrics collected by caller, e.g. on thread which uses connection
+	//They are rendered until they are updated again or removed
+	void update(const std::string& name, const SQLite3Metrics& metrics);
+
+	//Removes connection or metrics registered under [name]
+	void remove(const std::string& name);
+
+	//Appends OpenMetrics text of all registered connections to [out]
+	void render(std::string& out) const;
+	std::string render() const;
+
+	//Appends OpenMetrics text of given metrics to [out], every pair is name of connection and its metrics
+	static void render(std::string& out, const std::vector<std::pair<std::string, SQLite3Metrics>>& metrics);
+};
+
+#endif
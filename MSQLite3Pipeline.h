@@ -0,0 +1,279 @@
+#ifndef MSQLite3PipelineH
+#define MSQLite3PipelineH
+#include "MSQLite3.h"
+#include <condition_variable>
+#include <mutex>
+
+//Lock-free queue for exactly one producer and one consumer thread
+//Capacity is rounded up to power of two
+//Side which can not continue waits by wait: it spins shortly and then sleeps on condition variable,
+//push and pop take the mutex only when other side sleeps
+template<typename T>
+class SpscRing
+{
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	//Next slot to read, written only by consumer
+	alignas(64) std::atomic<size_t> head;
+
+	//Next slot to write, written only by producer
+	alignas(64) std::atomic<size_t> tail;
+
+	//Sleeping side of ring
+	alignas(64) std::atomic<int> sleepers;
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	//Count of checks done before waiting side sleeps
+	static constexpr int spins = 64;
+
+	static size_t roundUp(size_t capacity)
+	{
+		size_t rval = 1;
+		while (rval < capacity)
+			rval <<= 1;
+		return rval;
+	}
+public:
+	explicit SpscRing(size_t capacity)
+		:slots(roundUp(capacity))
+		,mask(slots.size() - 1)
+		,head(0)
+		,tail(0)
+		,sleepers(0)
+	{}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	//Moves value into ring, returns false if ring is full
+	bool push(T& value)
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size())
+			return false;
+		slots[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		wake();
+		return true;
+	}
+
+	//Moves oldest value out of ring, returns false if ring is empty
+	bool pop(T& value)
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		wake();
+		return true;
+	}
+
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	bool full() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire) == slots.size();
+	}
+
+	//Waits until [ready] returns true, [ready] is checked again after every push, pop and wake
+	template<typename Ready>
+	void wait(Ready ready)
+	{
+		for (int i = 0; i < spins; ++i) {
+			if (ready())
+				return;
+			std::this_thread::yield();
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		//Read-modify-writes of sleepers are ordered with the one in wake:
+		//either wake sees the sleeper, or this one sees the change published before wake
+		sleepers.fetch_add(1, std::memory_order_acq_rel);
+		changed.wait(lock, ready);
+		sleepers.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	//Wakes sleeping side, called after change of state checked by its [ready]
+	void wake()
+	{
+		if (sleepers.fetch_add(0, std::memory_order_acq_rel) > 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			changed.notify_all();
+		}
+	}
+};
+
+//Options of executePipelined
+struct PipelineOptions
+{
+	//Count of threads which process rows
+	unsigned consumers = 1;
+
+	//Count of rows passed to consumer at once
+	size_t batchSize = 256;
+
+	//Count of batches in flight per consumer, producer waits when all of them are full
+	size_t depth = 8;
+};
+
+//Executes statement on calling thread and processes returned rows by [onRow] on consumer threads
+//Rows are copied into fixed-size batches which are passed to consumers through SPSC rings,
+//so stepping of statement overlaps with processing of rows read before
+//Batches are dealt to consumers in turn, with more than one consumer rows are not processed in order
+//and [onRow] is called concurrently
+//Empty batches are returned to producer through second ring and reused
+//If [onRow] throws, stepping stops and the exception is rethrown after consumers finished,
+//statement has to be reset before it is executed again
+//example
+/*
+	auto ps = db.createPreparedStatement("SELECT * FROM Receipt");
+	executePipelined(ps, [&](const ResultRow& row) {
+		process(row.get<std::string>("uniqueNumber"));
+	});
+*/
+template<typename F>
+void executePipelined(PreparedStatement& ps, F onRow, const PipelineOptions& options = PipelineOptions())
+{
+	typedef std::vector<ResultRow> RowBatch;
+
+	struct Lane
+	{
+		SpscRing<RowBatch> full;
+		SpscRing<RowBatch> free;
+		std::thread thread;
+
+		explicit Lane(size_t depth)
+			:full(depth)
+			,free(depth)
+		{}
+	};
+
+	//Thrown from row callback to stop stepping when consumer failed
+	struct Stop {};
+
+	const size_t batchSize = std::max<size_t>(1, options.batchSize);
+	const size_t depth = std::max<size_t>(1, options.depth);
+	std::atomic<bool> done(false);
+	std::atomic<bool> failed(false);
+	std::exception_ptr consumerError;
+
+	std::vector<std::unique_ptr<Lane>> lanes;
+	for (unsigned i = 0; i < std::max(1u, options.consumers); ++i) {
+		lanes.push_back(std::make_unique<Lane>(depth));
+		for (size_t j = 0; j < depth; ++j) {
+			RowBatch batch;
+			batch.reserve(batchSize);
+			lanes.back()->free.push(batch);
+		}
+	}
+
+	auto consume = [&](Lane& lane) {
+		RowBatch batch;
+		for (;;) {
+			if (!lane.full.pop(batch)) {
+				lane.full.wait([&]() { return !lane.full.empty() || done.load(std::memory_order_acquire); });
+				//Producer publishes last batch before done, so ring has to be checked once more
+				if (!lane.full.pop(batch)) {
+					if (done.load(std::memory_order_acquire))
+						break;
+					continue;
+				}
+			}
+			if (!failed.load(std::memory_order_relaxed)) {
+				try {
+					for (const ResultRow& row : batch)
+						onRow(row);
+				}
+				catch (...) {
+					//Only first failing consumer stores its exception
+					if (!failed.exchange(true))
+						consumerError = std::current_exception();
+				}
+			}
+			batch.clear();
+			lane.free.push(batch);
+		}
+	};
+
+	//Stops and joins consumers also when starting of thread or stepping throws
+	struct Joiner
+	{
+		std::vector<std::unique_ptr<Lane>>& lanes;
+		std::atomic<bool>& done;
+
+		void join()
+		{
+			done.store(true, std::memory_order_release);
+			for (auto& lane : lanes) {
+				lane->full.wake();
+				if (lane->thread.joinable())
+					lane->thread.join();
+			}
+		}
+
+		~Joiner()
+		{
+			join();
+		}
+	} joiner{ lanes, done };
+
+	for (auto& lane : lanes)
+		lane->thread = std::thread(consume, std::ref(*lane));
+
+	size_t current = 0;
+	RowBatch batch;
+	auto acquire = [&]() {
+		SpscRing<RowBatch>& free = lanes[current]->free;
+		for (;;) {
+			if (failed.load(std::memory_order_relaxed))
+				throw Stop();
+			if (free.pop(batch))
+				return;
+			//Failing consumer still returns its batches, so producer is woken
+			free.wait([&]() { return !free.empty() || failed.load(std::memory_order_relaxed); });
+		}
+	};
+	auto publish = [&]() {
+		SpscRing<RowBatch>& full = lanes[current]->full;
+		while (!full.push(batch))
+			full.wait([&]() { return !full.full(); });
+		current = (current + 1) % lanes.size();
+	};
+
+	std::exception_ptr producerError;
+	try {
+		acquire();
+		//Rows of all batches share one schema
+		std::shared_ptr<const ResultSchema> schema;
+		ps.forEachRow([&](sqlite3_stmt* stmt) {
+			if (!schema)
+				schema = ResultSchema::fromStatement(stmt);
+			batch.emplace_back(schema, stmt);
+			if (batch.size() == batchSize) {
+				publish();
+				acquire();
+			}
+		});
+		if (!batch.empty())
+			publish();
+	}
+	catch (const Stop&) {
+	}
+	catch (...) {
+		producerError = std::current_exception();
+	}
+
+	joiner.join();
+
+	if (consumerError)
+		std::rethrow_exception(consumerError);
+	if (producerError)
+		std::rethrow_exception(producerError);
+}
+
+#endif
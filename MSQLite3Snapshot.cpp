@@ -0,0 +1,59 @@
+#include "MSQLite3Snapshot.h"
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+
+namespace {
+
+//Snapshot functions do not always leave message on connection, so code is described by sqlite3_errstr
+void check(int rc, const char* what)
+{
+	if (rc != SQLITE_OK)
+		throwError(SQLite3ErrorInfo::fromCode(rc, std::string(what) + ": " + sqlite3_errstr(rc)));
+}
+
+}
+
+Snapshot::Snapshot(sqlite3_snapshot* snapshot, const std::string& schema)
+	:snapshot(snapshot, sqlite3_snapshot_free)
+	,schema(schema)
+{
+}
+
+Snapshot Snapshot::capture(SQLite3& db, const std::string& schema)
+{
+	const bool ownTransaction = !db.inTransaction();
+	if (ownTransaction) {
+		db.beginTransaction();
+		//Read transaction starts with first read of database
+		db.tryExecute(("SELECT 1 FROM " + SQLite3::quote(schema) + ".sqlite_master LIMIT 1").c_str());
+	}
+
+	sqlite3_snapshot* snapshot = nullptr;
+	const int rc = sqlite3_snapshot_get(db.handle(), schema.c_str(), &snapshot);
+	if (ownTransaction)
+		db.tryExecute("COMMIT");
+	check(rc, "Snapshot can not be captured");
+	return Snapshot(snapshot, schema);
+}
+
+void Snapshot::open(SQLite3& db) const
+{
+	db.beginTransaction();
+	const int rc = sqlite3_snapshot_open(db.handle(), schema.c_str(), snapshot.get());
+	if (rc != SQLITE_OK) {
+		db.tryExecute("ROLLBACK");
+		check(rc, "Snapshot can not be opened");
+	}
+}
+
+void Snapshot::recover(SQLite3& db, const std::string& schema)
+{
+	check(sqlite3_snapshot_recover(db.handle(), schema.c_str()), "Snapshots can not be recovered");
+}
+
+int Snapshot::compare(const Snapshot& other) const
+{
+	return sqlite3_snapshot_cmp(snapshot.get(), other.snapshot.get());
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef MSQLite3SnapshotH
+#define MSQLite3SnapshotH
+#include "MSQLite3.h"
+
+//Snapshot API needs SQLite built with SQLITE_ENABLE_SNAPSHOT and database in WAL mode
+#ifdef SQLITE_ENABLE_SNAPSHOT
+
+//Snapshot identifies point in time view of WAL database
+//It is captured on one connection and opened by read transactions of other connections of the same database,
+//so several connections can run queries in parallel which all see the same consistent data
+//Snapshot can be opened only until WAL is checkpointed past it; to guarantee it stays usable,
+//capture it on connection which keeps its read transaction open while snapshot is used
+//example
+/*
+	Snapshot snapshot = Snapshot::capture(db);
+	//on other threads, each with its own connection
+	SnapshotTransaction st(reader, snapshot);
+	auto rs = reader.executeQuery("SELECT sum(total) total FROM Receipt");
+*/
+class Snapshot
+{
+private:
+	std::shared_ptr<sqlite3_snapshot> snapshot;
+	std::string schema;
+
+	Snapshot(sqlite3_snapshot* snapshot, const std::string& schema);
+public:
+	//Captures snapshot of read transaction of [db]
+	//If no transaction is open, read transaction is started for capture and ended afterwards
+	//[schema] is name of attached database, main by default
+	static Snapshot capture(SQLite3& db, const std::string& schema = "main");
+
+	//Starts read transaction on [db] which sees data of snapshot
+	//Connection must not be in transaction, transaction is ended by endTransaction
+	//Throws SQLite3Error with extended code SQLITE_ERROR_SNAPSHOT if snapshot is no longer available
+	void open(SQLite3& db) const;
+
+	//Tries to make snapshots taken before last connection closed usable again, see sqlite3_snapshot_recover
+	static void recover(SQLite3& db, const std::string& schema = "main");
+
+	//Returns negative value if this snapshot is older than [other], positive if newer and 0 if they are equal
+	//Both snapshots have to be taken on the same database file
+	int compare(const Snapshot& other) const;
+
+	bool operator<(const Snapshot& other) const {
+		return compare(other) < 0;
+	}
+
+	bool operator==(const Snapshot& other) const {
+		return compare(other) == 0;
+	}
+};
+
+//Guard of read transaction opened at snapshot
+//Transaction starts at the inicialization of the object and ends at destruction
+class SnapshotTransaction
+{
+private:
+	SQLite3& db;
+public:
+	SnapshotTransaction(SQLite3& db, const Snapshot& snapshot)
+		:db(db)
+	{
+		snapshot.open(db);
+	}
+
+	~SnapshotTransaction()
+	{
+		try {
+			db.endTransaction();
+		}
+		catch (...) {
+		}
+	}
+
+	SnapshotTransaction(const SnapshotTransaction&) = delete;
+	SnapshotTransaction& operator=(const SnapshotTransaction&) = delete;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef MSQLite3TableH
+#define MSQLite3TableH
+#include "MSQLite3.h"
+#include <optional>
+#include <tuple>
+
+//Reads value of column [index] of current row of [stmt] into [value]
+//NULL is read as zero or empty string
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value>::type readColumn(sqlite3_stmt* stmt, int index, T& value)
+{
+	value = static_cast<T>(sqlite3_column_int64(stmt, index));
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type readColumn(sqlite3_stmt* stmt, int index, T& value)
+{
+	value = static_cast<T>(sqlite3_column_double(stmt, index));
+}
+
+inline void readColumn(sqlite3_stmt* stmt, int index, bool& value)
+{
+	value = sqlite3_column_int64(stmt, index) != 0;
+}
+
+inline void readColumn(sqlite3_stmt* stmt, int index, char& value)
+{
+	const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+	value = text ? text[0] : '\0';
+}
+
+inline void readColumn(sqlite3_stmt* stmt, int index, std::string& value)
+{
+	const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+	if (text)
+		value.assign(text, sqlite3_column_bytes(stmt, index));
+	else
+		value.clear();
+}
+
+//Column of table mapped to member of record type
+template<typename Record, typename T>
+struct TableColumn
+{
+	std::string name;
+	T Record::* member;
+};
+
+//Creates column description, [name] is name of column in database
+template<typename Record, typename T>
+TableColumn<Record, T> column(const std::string& name, T Record::* member)
+{
+	return { name, member };
+}
+
+//Table maps rows of database table to instances of Record
+//Columns are described once by name and member pointer, INSERT, UPDATE, DELETE and SELECT statements
+//are generated in constructor and cached on connection, rows are decoded directly from statement
+//by column position, without ResultSet and lookups by column name
+//First [keyCount] columns form primary key
+//example
+/*
+	struct User { int id; std::string name; double score; };
+
+	Table users(db, "User", 1, column("id", &User::id), column("name", &User::name), column("score", &User::score));
+	users.create();
+	users.insert({ 1, "Alice", 10.5 });
+	std::optional<User> alice = users.find(1);
+	std::vector<User> best = users.where("score > ?", 10);
+*/
+template<typename Record, typename ...Types>
+class Table
+{
+private:
+	SQLite3& db;
+	std::string table;
+	std::tuple<TableColumn<Record, Types>...> columns;
+	size_t keyCount;
+
+	//Generated statements
+	std::string insertSql;
+	std::string updateSql;
+	std::string removeSql;
+	std::string selectSql;
+	std::string findSql;
+
+	template<typename T>
+	static const char* affinity()
+	{
+		if (std::is_integral<T>::value && !std::is_same<T, char>::value)
+			return "INTEGER";
+		if (std::is_floating_point<T>::value)
+			return "REAL";
+		return "TEXT";
+	}
+
+	std::vector<std::string> names() const
+	{
+		return std::apply([](const auto&... column) {
+			return std::vector<std::string>{ column.name... };
+		}, columns);
+	}
+
+	//Parameter ?N is N-th column, so every statement binds the whole record or its key in declaration order
+	void generate()
+	{
+		const std::vector<std::string> columnNames = names();
+		std::string all, params, assignments, keys;
+		for (size_t i = 0; i < columnNames.size(); ++i) {
+			const std::string name = SQLite3::quote(columnNames[i]);
+			const std::string param = "?" + std::to_string(i + 1);
+			all += (i ? "," : "") + name;
+			params += (i ? "," : "") + param;
+			if (i < keyCount)
+				keys += (i ? " AND " : "") + name + "=" + param;
+			else
+				assignments += (assignments.empty() ? "" : ",") + name + "=" + param;
+		}
+
+		insertSql = "INSERT INTO " + SQLite3::quote(table) + "(" + all + ") VALUES(" + params + ")";
+		updateSql = assignments.empty() ? "" : "UPDATE " + SQLite3::quote(table) + " SET " + assignments + " WHERE " + keys;
+		removeSql = "DELETE FROM " + SQLite3::quote(table) + " WHERE " + keys;
+		selectSql = "SELECT " + all + " FROM " + SQLite3::quote(table);
+		findSql = selectSql + " WHERE " + keys;
+	}
+
+	template<size_t ...I>
+	void bindRecord(PreparedStatement& ps, const Record& record, std::index_sequence<I...>) const
+	{
+		ps.bind(record.*(std::get<I>(columns).member)...);
+	}
+
+	template<size_t ...I>
+	void decode(sqlite3_stmt* stmt, Record& record, std::index_sequence<I...>) const
+	{
+		using expander = int[];
+		(void)expander {
+			0, (readColumn(stmt, static_cast<int>(I), record.*(std::get<I>(columns).member)), 0)...
+		};
+	}
+
+	std::vector<Record> collect(PreparedStatement& ps) const
+	{
+		std::vector<Record> rval;
+		ps.forEachRow([&](sqlite3_stmt* stmt) {
+			rval.emplace_back();
+			decode(stmt, rval.back(), std::index_sequence_for<Types...>());
+		});
+		return rval;
+	}
+public:
+	//[table] name of table, [keyCount] count of leading columns which form primary key
+	Table(SQLite3& db, const std::string& table, size_t keyCount, TableColumn<Record, Types>... columns)
+		:db(db)
+		,table(table)
+		,columns(std::move(columns)...)
+		,keyCount(keyCount)
+	{
+		if (keyCount == 0 || keyCount > sizeof...(Types))
+			throw SQLite3Error("Count of key columns has to be between 1 and count of columns");
+		generate();
+	}
+
+	//Creates table if it does not exist, column types are derived from member types
+	void create()
+	{
+		const std::vector<std::string> columnNames = names();
+		const char* types[] = { affinity<Types>()... };
+		std::string definition, keys;
+		for (size_t i = 0; i < columnNames.size(); ++i) {
+			definition += (i ? "," : "") + SQLite3::quote(columnNames[i]) + " " + types[i];
+			if (i < keyCount)
+				keys += (i ? "," : "") + SQLite3::quote(columnNames[i]);
+		}
+		db.execute(("CREATE TABLE IF NOT EXISTS " + SQLite3::quote(table) + "(" + definition + ",PRIMARY KEY(" + keys + "))").c_str());
+	}
+
+	//Inserts record, throws if row with the same key exists
+	void insert(const Record& record)
+	{
+		PreparedStatement& ps = db.cachedStatement(insertSql);
+		bindRecord(ps, record, std::index_sequence_for<Types...>());
+		ps.execute();
+	}
+
+	//Updates row with key of record, returns false if no such row exists
+	bool update(const Record& record)
+	{
+		if (updateSql.empty())
+			throw SQLite3Error("Table " + table + " has no columns outside of key to update");
+		PreparedStatement& ps = db.cachedStatement(updateSql);
+		bindRecord(ps, record, std::index_sequence_for<Types...>());
+		ps.execute();
+		return db.changes() > 0;
+	}
+
+	//Deletes row with given key, returns false if no such row exists
+	template<typename ...Keys>
+	bool remove(const Keys&... keys)
+	{
+		db.cachedStatement(removeSql).bind(keys...).execute();
+		return db.changes() > 0;
+	}
+
+	//Returns row with given key
+	template<typename ...Keys>
+	std::optional<Record> find(const Keys&... keys)
+	{
+		std::optional<Record> rval;
+		db.cachedStatement(findSql).bind(keys...).forEachRow([&](sqlite3_stmt* stmt) {
+			rval.emplace();
+			decode(stmt, *rval, std::index_sequence_for<Types...>());
+		});
+		return rval;
+	}
+
+	//Returns all rows of table
+	std::vector<Record> all()
+	{
+		return collect(db.cachedStatement(selectSql));
+	}
+
+	//Returns rows matching [condition], which is appended to SELECT after WHERE
+	//Statement is cached per condition, so values should be passed as parameters
+	template<typename ...Args>
+	std::vector<Record> where(const std::string& condition, Args&&... args)
+	{
+		PreparedStatement& ps = db.cachedStatement(selectSql + " WHERE " + condition);
+		ps.bind(std::forward<Args>(args)...);
+		return collect(ps);
+	}
+
+	//Decodes current row of statement which selects columns of table in declaration order
+	Record decode(sqlite3_stmt* stmt) const
+	{
+		Record rval{};
+		decode(stmt, rval, std::index_sequence_for<Types...>());
+		return rval;
+	}
+
+	//Returns generated statements
+	const std::string& insertQuery() const { return insertSql; }
+	const std::string& updateQuery() const { return updateSql; }
+	const std::string& removeQuery() const { return removeSql; }
+	const std::string& selectQuery() const { return selectSql; }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef MSQLite3UpsertH
+#define MSQLite3UpsertH
+#include "MSQLite3.h"
+#include <limits>
+#include <tuple>
+
+//Outcome of one upsert
+enum class UpsertResult
+{
+	Inserted,
+	Updated,
+	//Row with the key exists and has the same values
+	Unchanged
+};
+
+//Counts of rows affected by Upsert::merge
+struct MergeResult
+{
+	size_t inserted = 0;
+	size_t updated = 0;
+	size_t unchanged = 0;
+};
+
+//Upsert inserts row or updates row with the same key by one statement
+//INSERT ... ON CONFLICT(key) DO UPDATE statement is generated once and cached on connection
+//Rows whose values did not change are not written at all
+//Column types are given as template parameters in the same order as column names
+//Inserted and updated rows are told apart by last inserted rowid, so for WITHOUT ROWID tables
+//every changed row is reported as updated
+//example
+/*
+	Upsert<int, std::string, double> upsertUser(db, "User", { "id", "name", "score" }, { "id" });
+
+	upsertUser(1, "Alice", 10.5);
+
+	std::vector<std::tuple<int, std::string, double>> users = ...;
+	MergeResult r = upsertUser.merge(users);
+*/
+template<typename ...Columns>
+class Upsert
+{
+private:
+	SQLite3& db;
+
+	//Generated statement
+	std::string sql;
+
+	static std::string generate(const std::string& table, const std::vector<std::string>& columns, const std::vector<std::string>& keys)
+	{
+		if (columns.size() != sizeof...(Columns))
+			throw SQLite3Error("Count of column names does not equal count of column types");
+		if (keys.empty())
+			throw SQLite3Error("Upsert needs at least one key column");
+		for (auto& key : keys)
+			if (std::find(columns.begin(), columns.end(), key) == columns.end())
+				throw ColumnNotFound(key);
+
+		std::string names, params, target, assignments, changed;
+		for (auto& column : columns) {
+			names += (names.empty() ? "" : ",") + SQLite3::quote(column);
+			params += params.empty() ? "?" : ",?";
+			if (std::find(keys.begin(), keys.end(), column) != keys.end())
+				continue;
+			assignments += (assignments.empty() ? "" : ",") + SQLite3::quote(column) + "=excluded." + SQLite3::quote(column);
+			changed += (changed.empty() ? "" : " OR ") + SQLite3::quote(column) + " IS NOT excluded." + SQLite3::quote(column);
+		}
+		for (auto& key : keys)
+			target += (target.empty() ? "" : ",") + SQLite3::quote(key);
+
+		std::string rval = "INSERT INTO " + SQLite3::quote(table) + "(" + names + ") VALUES(" + params + ") ON CONFLICT(" + target + ") DO ";
+		return rval + (assignments.empty() ? "NOTHING" : "UPDATE SET " + assignments + " WHERE " + changed);
+	}
+
+	template<typename Tuple, size_t ...I>
+	UpsertResult apply(const Tuple& record, std::index_sequence<I...>)
+	{
+		return (*this)(std::get<I>(record)...);
+	}
+public:
+	//[table] name of table, [columns] names of columns in order of template parameters
+	//[keys] columns of PRIMARY KEY or UNIQUE constraint used to find existing row
+	Upsert(SQLite3& db, const std::string& table, const std::vector<std::string>& columns, const std::vector<std::string>& keys)
+		:db(db)
+		,sql(generate(table, columns, keys))
+	{}
+
+	//returns generated statement
+	const std::string& query() const {
+		return sql;
+	}
+
+	//Inserts or updates one row
+	UpsertResult operator()(const Columns&... values)
+	{
+		PreparedStatement& ps = db.cachedStatement(sql);
+		ps.bind(values...);
+
+		//Rowid is set only by the insert path, sentinel shows which path was taken
+		const sqlite_int64 previousId = db.lastId();
+		const sqlite_int64 sentinel = std::numeric_limits<sqlite_int64>::min();
+		sqlite3_set_last_insert_rowid(db.handle(), sentinel);
+		try {
+			ps.execute();
+		}
+		catch (...) {
+			sqlite3_set_last_insert_rowid(db.handle(), previousId);
+			throw;
+		}
+
+		if (db.lastId() != sentinel)
+			return UpsertResult::Inserted;
+		sqlite3_set_last_insert_rowid(db.handle(), previousId);
+		return db.changes() > 0 ? UpsertResult::Updated : UpsertResult::Unchanged;
+	}
+
+	//Applies range of records in one transaction, record is std::tuple<Columns...> or other tuple-like type
+	//If connection is already in transaction records become part of it,
+	//otherwise transaction is rolled back when any record fails
+	template<typename Iterator>
+	MergeResult merge(Iterator first, Iterator last)
+	{
+		ScopedTransaction transaction(db);
+		MergeResult rval;
+		for (; first != last; ++first) {
+			switch (apply(*first, std::index_sequence_for<Columns...>())) {
+			case UpsertResult::Inserted: ++rval.inserted; break;
+			case UpsertResult::Updated: ++rval.updated; break;
+			case UpsertResult::Unchanged: ++rval.unchanged; break;
+			}
+		}
+		transaction.commit();
+		return rval;
+	}
+
+	template<typename Range>
+	MergeResult merge(const Range& records)
+	{
+		return merge(std::begin(records), std::end(records));
+	}
+};
+
+#endif
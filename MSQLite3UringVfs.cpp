@@ -0,0 +1,923 @@
+#include "MSQLite3UringVfs.h"
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+//------------------------Ring-----------------------------//
+
+//Minimal io_uring ring driven by raw system calls, so liburing is not needed
+class Ring
+{
+private:
+	int fd;
+	unsigned entries;
+
+	void* sqMap;
+	size_t sqMapSize;
+	void* cqMap;
+	size_t cqMapSize;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	io_uring_cqe* cqes;
+
+	//Entries filled but not yet passed to kernel
+	unsigned pending;
+
+	template<typename T>
+	static T* at(void* base, unsigned offset)
+	{
+		return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+	}
+public:
+	Ring()
+		:fd(-1), entries(0), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0)
+		, sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize(0), pending(0)
+	{}
+
+	~Ring()
+	{
+		if (sqes != MAP_FAILED)
+			munmap(sqes, sqesSize);
+		if (cqMap != MAP_FAILED && cqMap != sqMap)
+			munmap(cqMap, cqMapSize);
+		if (sqMap != MAP_FAILED)
+			munmap(sqMap, sqMapSize);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	Ring(const Ring&) = delete;
+	Ring& operator=(const Ring&) = delete;
+
+	bool init(unsigned depth)
+	{
+		io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &p));
+		if (fd < 0)
+			return false;
+		entries = p.sq_entries;
+
+		sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single)
+			sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+		sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqMap == MAP_FAILED)
+			return false;
+		cqMap = single ? sqMap
+			: mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqMap == MAP_FAILED)
+			return false;
+		sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED)
+			return false;
+
+		sqHead = at<unsigned>(sqMap, p.sq_off.head);
+		sqTail = at<unsigned>(sqMap, p.sq_off.tail);
+		sqMask = at<unsigned>(sqMap, p.sq_off.ring_mask);
+		sqArray = at<unsigned>(sqMap, p.sq_off.array);
+		cqHead = at<unsigned>(cqMap, p.cq_off.head);
+		cqTail = at<unsigned>(cqMap, p.cq_off.tail);
+		cqMask = at<unsigned>(cqMap, p.cq_off.ring_mask);
+		cqes = at<io_uring_cqe>(cqMap, p.cq_off.cqes);
+		return true;
+	}
+
+	//Count of entries which can be queued before submit
+	unsigned space() const
+	{
+		return entries - (*sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+	}
+
+	//Returns cleared entry to fill or null if submission queue is full
+	io_uring_sqe* get()
+	{
+		const unsigned tail = *sqTail;
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= entries)
+			return nullptr;
+		io_uring_sqe* sqe = &sqes[tail & *sqMask];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqArray[tail & *sqMask] = tail & *sqMask;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		++pending;
+		return sqe;
+	}
+
+	//Passes queued entries to kernel and waits for at least [waitFor] completions
+	int submit(unsigned waitFor)
+	{
+		for (;;) {
+			int rc = static_cast<int>(syscall(__NR_io_uring_enter, fd, pending, waitFor,
+				waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+			if (rc >= 0) {
+				pending -= std::min(pending, static_cast<unsigned>(rc));
+				return 0;
+			}
+			if (errno != EINTR)
+				return -errno;
+		}
+	}
+
+	//Takes one completion if available
+	bool pop(io_uring_cqe& out)
+	{
+		const unsigned head = *cqHead;
+		if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+			return false;
+		out = cqes[head & *cqMask];
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+//------------------------Shared descriptors-----------------------------//
+
+//Descriptors opened by this VFS, shared by all files of one inode
+//Closing of any descriptor releases all POSIX locks of process on file, so like unixInodeInfo of default VFS
+//every descriptor of inode is kept open until last file using the inode is closed
+//Descriptor is opened read-write when possible, so read-only and read-write connections share it
+struct Descriptor
+{
+	int fd;
+	bool writable;
+	unsigned refs;
+	//Descriptors replaced by read-write one, other files may still use them
+	std::vector<int> pending;
+};
+
+typedef std::pair<dev_t, ino_t> InodeKey;
+
+std::mutex descriptorMutex;
+std::map<InodeKey, Descriptor> descriptors;
+
+int openDescriptor(const char* path, bool writable, bool& opened)
+{
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+	opened = fd >= 0;
+	if (fd < 0 && !writable && (errno == EACCES || errno == EROFS || errno == EPERM))
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	return fd;
+}
+
+int acquireDescriptor(const char* path, bool writable, InodeKey& key)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return -1;
+	key = InodeKey(st.st_dev, st.st_ino);
+
+	std::lock_guard<std::mutex> lock(descriptorMutex);
+	auto it = descriptors.find(key);
+	if (it == descriptors.end()) {
+		bool readWrite;
+		const int fd = openDescriptor(path, writable, readWrite);
+		if (fd >= 0)
+			descriptors[key] = Descriptor{ fd, readWrite, 1, {} };
+		return fd;
+	}
+
+	Descriptor& d = it->second;
+	if (writable && !d.writable) {
+		const int fd = open(path, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+		d.pending.push_back(d.fd);
+		d.fd = fd;
+		d.writable = true;
+	}
+	++d.refs;
+	return d.fd;
+}
+
+void releaseDescriptor(const InodeKey& key)
+{
+	std::lock_guard<std::mutex> lock(descriptorMutex);
+	auto it = descriptors.find(key);
+	if (it == descriptors.end() || --it->second.refs > 0)
+		return;
+	close(it->second.fd);
+	for (int fd : it->second.pending)
+		close(fd);
+	descriptors.erase(it);
+}
+
+//------------------------VFS state-----------------------------//
+
+sqlite3_vfs uringVfs;
+unsigned queueDepth = 64;
+unsigned readaheadPages = 16;
+std::atomic<bool> available{ false };
+
+sqlite3_vfs* realVfs()
+{
+	return static_cast<sqlite3_vfs*>(uringVfs.pAppData);
+}
+
+const uint64_t syncTag = ~0ull;
+const int walHeaderSize = 32;
+const int walFrameHeaderSize = 24;
+
+//io_uring state of main database or WAL file
+struct UringState
+{
+	int fd = -1;
+	InodeKey key;
+	bool isWal = false;
+	bool synced = false;
+
+	//Page read ahead
+	struct Slot
+	{
+		enum { Empty, InFlight, Ready } status = Empty;
+		//Result of in flight read is thrown away, file changed since submission
+		bool stale = false;
+		sqlite3_int64 offset = -1;
+		int amount = 0;
+		int result = 0;
+		std::vector<char> buffer;
+	};
+	std::vector<Slot> slots;
+	unsigned inFlight = 0;
+	sqlite3_int64 lastEnd = -1;
+	unsigned sequential = 0;
+
+	//Queued WAL writes
+	struct Write
+	{
+		sqlite3_int64 offset;
+		std::vector<char> data;
+	};
+	std::vector<Write> writes;
+	//Commit frame header was queued, its page ends transaction
+	bool commitPending = false;
+
+	//Declared last so it is destroyed first, before buffers of read ahead and queued writes
+	Ring ring;
+
+	//Waits for one completion, completions of read ahead are recorded in their slot
+	int reap(io_uring_cqe& cqe)
+	{
+		while (!ring.pop(cqe)) {
+			int rc = ring.submit(1);
+			if (rc < 0)
+				return rc;
+		}
+		if (cqe.user_data < slots.size()) {
+			Slot& slot = slots[cqe.user_data];
+			--inFlight;
+			slot.result = cqe.res;
+			slot.status = slot.stale ? Slot::Empty : Slot::Ready;
+			slot.stale = false;
+		}
+		return 0;
+	}
+
+	//Waits until kernel finished all read ahead, so their buffers can be freed
+	int drain()
+	{
+		io_uring_cqe cqe;
+		while (inFlight > 0)
+			if (reap(cqe) < 0)
+				return SQLITE_IOERR_CLOSE;
+		return SQLITE_OK;
+	}
+
+	//Drops read ahead pages, file is about to change or lock was released
+	void invalidate()
+	{
+		for (auto& slot : slots) {
+			if (slot.status == Slot::InFlight)
+				slot.stale = true;
+			else
+				slot.status = Slot::Empty;
+		}
+		sequential = 0;
+	}
+
+	//Finishes I/O with plain system calls after short transfer
+	static int finishRead(int fd, char* out, int amount, sqlite3_int64 offset, int done)
+	{
+		while (done < amount) {
+			ssize_t n = pread(fd, out + done, amount - done, offset + done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				return SQLITE_IOERR_READ;
+			if (n == 0) {
+				std::memset(out + done, 0, amount - done);
+				return SQLITE_IOERR_SHORT_READ;
+			}
+			done += static_cast<int>(n);
+		}
+		return SQLITE_OK;
+	}
+
+	static int finishWrite(int fd, const char* data, int amount, sqlite3_int64 offset, int done)
+	{
+		while (done < amount) {
+			ssize_t n = pwrite(fd, data + done, amount - done, offset + done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return errno == ENOSPC ? SQLITE_FULL : SQLITE_IOERR_WRITE;
+			done += static_cast<int>(n);
+		}
+		return SQLITE_OK;
+	}
+
+	//Submits all queued writes, optionally followed by fsync, and waits for them
+	int flush(bool sync, bool dataOnly)
+	{
+		int rc = SQLITE_OK;
+		size_t next = 0;
+		while (next < writes.size() || sync) {
+			//Queue as many writes as ring allows, fsync is drained behind them
+			unsigned queued = 0;
+			while (next < writes.size() && ring.space() > (sync ? 1u : 0u)) {
+				io_uring_sqe* sqe = ring.get();
+				sqe->opcode = IORING_OP_WRITE;
+				sqe->fd = fd;
+				sqe->off = writes[next].offset;
+				sqe->addr = reinterpret_cast<uint64_t>(writes[next].data.data());
+				sqe->len = static_cast<uint32_t>(writes[next].data.size());
+				sqe->user_data = syncTag - 1 - next;
+				++next;
+				++queued;
+			}
+			const bool lastRound = next == writes.size();
+			if (sync && lastRound) {
+				io_uring_sqe* sqe = ring.get();
+				sqe->opcode = IORING_OP_FSYNC;
+				sqe->fd = fd;
+				sqe->flags = IOSQE_IO_DRAIN;
+				sqe->fsync_flags = dataOnly ? IORING_FSYNC_DATASYNC : 0;
+				sqe->user_data = syncTag;
+				++queued;
+			}
+
+			int sub = ring.submit(0);
+			if (sub < 0)
+				return SQLITE_IOERR;
+
+			//Read ahead completions can be mixed in, they are recorded by reap
+			while (queued > 0) {
+				io_uring_cqe cqe;
+				if (reap(cqe) < 0)
+					return SQLITE_IOERR;
+				if (cqe.user_data < slots.size())
+					continue;
+				--queued;
+				if (cqe.user_data == syncTag) {
+					if (cqe.res < 0 && rc == SQLITE_OK)
+						rc = SQLITE_IOERR_FSYNC;
+					continue;
+				}
+				const Write& w = writes[syncTag - 1 - cqe.user_data];
+				const int done = cqe.res < 0 ? 0 : cqe.res;
+				int wrc = cqe.res < 0 && cqe.res != -EAGAIN ? (cqe.res == -ENOSPC ? SQLITE_FULL : SQLITE_IOERR_WRITE)
+					: finishWrite(fd, w.data.data(), static_cast<int>(w.data.size()), w.offset, done);
+				if (wrc != SQLITE_OK && rc == SQLITE_OK)
+					rc = wrc;
+			}
+			if (lastRound)
+				break;
+		}
+		writes.clear();
+		commitPending = false;
+		return rc;
+	}
+
+	//Reads synchronously through ring
+	int readNow(char* out, int amount, sqlite3_int64 offset)
+	{
+		if (ring.space() == 0)
+			return finishRead(fd, out, amount, offset, 0);
+		io_uring_sqe* sqe = ring.get();
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->off = offset;
+		sqe->addr = reinterpret_cast<uint64_t>(out);
+		sqe->len = amount;
+		sqe->user_data = syncTag;
+		if (ring.submit(0) < 0)
+			return SQLITE_IOERR_READ;
+
+		io_uring_cqe cqe;
+		do {
+			if (reap(cqe) < 0)
+				return SQLITE_IOERR_READ;
+		} while (cqe.user_data != syncTag);
+
+		if (cqe.res < 0 && cqe.res != -EAGAIN)
+			return SQLITE_IOERR_READ;
+		return finishRead(fd, out, amount, offset, cqe.res < 0 ? 0 : cqe.res);
+	}
+
+	//Submits reads of pages following sequential read
+	void readAhead(sqlite3_int64 from, int amount)
+	{
+		for (unsigned i = 0; i < slots.size() && ring.space() > 1; ++i) {
+			const sqlite3_int64 offset = from + static_cast<sqlite3_int64>(i) * amount;
+			bool present = false;
+			Slot* free = nullptr;
+			for (auto& slot : slots) {
+				if (slot.status != Slot::Empty && !slot.stale && slot.offset == offset)
+					present = true;
+				else if (slot.status != Slot::InFlight && (!free || (free->status == Slot::Ready && slot.status == Slot::Empty)))
+					free = &slot;
+			}
+			if (present)
+				continue;
+			if (!free)
+				break;
+
+			free->buffer.resize(amount);
+			free->offset = offset;
+			free->amount = amount;
+			free->status = Slot::InFlight;
+			++inFlight;
+			io_uring_sqe* sqe = ring.get();
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = fd;
+			sqe->off = offset;
+			sqe->addr = reinterpret_cast<uint64_t>(free->buffer.data());
+			sqe->len = amount;
+			sqe->user_data = free - slots.data();
+		}
+		ring.submit(0);
+	}
+
+	int read(char* out, int amount, sqlite3_int64 offset)
+	{
+		if (!writes.empty()) {
+			int rc = flush(false, false);
+			if (rc != SQLITE_OK)
+				return rc;
+		}
+
+		sequential = offset == lastEnd ? sequential + 1 : 0;
+		lastEnd = offset + amount;
+
+		int rc = -1;
+		for (auto& slot : slots) {
+			if (slot.offset != offset || slot.amount != amount || slot.stale || slot.status == Slot::Empty)
+				continue;
+			io_uring_cqe cqe;
+			while (slot.status == Slot::InFlight)
+				if (reap(cqe) < 0)
+					return SQLITE_IOERR_READ;
+			if (slot.status != Slot::Ready)
+				break;
+			slot.status = Slot::Empty;
+			if (slot.result < 0)
+				break;
+			std::memcpy(out, slot.buffer.data(), slot.result);
+			rc = finishRead(fd, out, amount, offset, slot.result);
+			break;
+		}
+		if (rc < 0)
+			rc = readNow(out, amount, offset);
+
+		if (rc == SQLITE_OK && sequential >= 2 && !slots.empty())
+			readAhead(offset + amount, amount);
+		return rc;
+	}
+
+	int write(const char* data, int amount, sqlite3_int64 offset)
+	{
+		invalidate();
+
+		if (isWal) {
+			//Frame header with non zero database size marks commit frame
+			bool commitPage = commitPending;
+			if (amount == walFrameHeaderSize && offset >= walHeaderSize) {
+				uint32_t commitSize = 0;
+				for (int i = 4; i < 8; ++i)
+					commitSize = (commitSize << 8) | static_cast<unsigned char>(data[i]);
+				commitPending = commitSize != 0;
+				commitPage = false;
+			}
+			writes.push_back(Write{ offset, std::vector<char>(data, data + amount) });
+
+			//Transaction becomes visible to readers right after commit frame, so it has to be on disk by then
+			if (commitPage || writes.size() >= queueDepth / 2)
+				return flush(false, false);
+			return SQLITE_OK;
+		}
+
+		if (ring.space() == 0)
+			return finishWrite(fd, data, amount, offset, 0);
+		writes.push_back(Write{ offset, std::vector<char>(data, data + amount) });
+		return flush(false, false);
+	}
+};
+
+//Opened file, file of wrapped VFS is allocated right behind this structure
+struct UringFile
+{
+	sqlite3_file base;
+	//Null if file is not accessed through io_uring
+	UringState* state;
+
+	sqlite3_file* real()
+	{
+		return reinterpret_cast<sqlite3_file*>(this + 1);
+	}
+};
+
+UringFile* uringFile(sqlite3_file* file)
+{
+	return reinterpret_cast<UringFile*>(file);
+}
+
+sqlite3_file* realFile(sqlite3_file* file)
+{
+	return uringFile(file)->real();
+}
+
+//------------------------File methods-----------------------------//
+
+int uringClose(sqlite3_file* file)
+{
+	UringFile* f = uringFile(file);
+	int rc = SQLITE_OK;
+	if (f->state) {
+		rc = f->state->flush(false, false);
+		//Kernel may still write into read ahead buffers until their reads complete,
+		//if waiting for them fails, state is leaked rather than freed under the kernel
+		const int drained = f->state->drain();
+		if (rc == SQLITE_OK)
+			rc = drained;
+		auto key = f->state->key;
+		if (drained == SQLITE_OK)
+			delete f->state;
+		f->state = nullptr;
+		releaseDescriptor(key);
+	}
+	int realRc = f->real()->pMethods ? f->real()->pMethods->xClose(f->real()) : SQLITE_OK;
+	return rc != SQLITE_OK ? rc : realRc;
+}
+
+int uringRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset)
+{
+	UringFile* f = uringFile(file);
+	if (!f->state)
+		return f->real()->pMethods->xRead(f->real(), buffer, amount, offset);
+	return f->state->read(static_cast<char*>(buffer), amount, offset);
+}
+
+int uringWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset)
+{
+	UringFile* f = uringFile(file);
+	if (!f->state)
+		return f->real()->pMethods->xWrite(f->real(), buffer, amount, offset);
+	return f->state->write(static_cast<const char*>(buffer), amount, offset);
+}
+
+int uringTruncate(sqlite3_file* file, sqlite3_int64 size)
+{
+	UringFile* f = uringFile(file);
+	if (f->state) {
+		int rc = f->state->flush(false, false);
+		if (rc != SQLITE_OK)
+			return rc;
+		f->state->invalidate();
+	}
+	return f->real()->pMethods->xTruncate(f->real(), size);
+}
+
+int uringSync(sqlite3_file* file, int flags)
+{
+	UringFile* f = uringFile(file);
+	if (!f->state)
+		return f->real()->pMethods->xSync(f->real(), flags);
+
+	//First sync is done by default VFS too, it also syncs directory of newly created file
+	int rc = f->state->flush(f->state->synced, (flags & SQLITE_SYNC_DATAONLY) != 0);
+	if (rc == SQLITE_OK && !f->state->synced) {
+		rc = f->real()->pMethods->xSync(f->real(), flags);
+		f->state->synced = rc == SQLITE_OK;
+	}
+	return rc;
+}
+
+int uringFileSize(sqlite3_file* file, sqlite3_int64* size)
+{
+	UringFile* f = uringFile(file);
+	if (f->state && !f->state->writes.empty()) {
+		int rc = f->state->flush(false, false);
+		if (rc != SQLITE_OK)
+			return rc;
+	}
+	return f->real()->pMethods->xFileSize(f->real(), size);
+}
+
+int uringLock(sqlite3_file* file, int lock)
+{
+	UringFile* f = uringFile(file);
+	if (f->state)
+		f->state->invalidate();
+	return f->real()->pMethods->xLock(f->real(), lock);
+}
+
+int uringUnlock(sqlite3_file* file, int lock)
+{
+	UringFile* f = uringFile(file);
+	if (f->state)
+		f->state->invalidate();
+	return f->real()->pMethods->xUnlock(f->real(), lock);
+}
+
+int uringCheckReservedLock(sqlite3_file* file, int* out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int uringFileControl(sqlite3_file* file, int op, void* arg)
+{
+	sqlite3_file* real = realFile(file);
+	int rc = real->pMethods->xFileControl(real, op, arg);
+	if (op == SQLITE_FCNTL_VFSNAME && rc == SQLITE_OK)
+		*static_cast<char**>(arg) = sqlite3_mprintf("%s/%z", UringVfs::name, *static_cast<char**>(arg));
+	return rc;
+}
+
+int uringSectorSize(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xSectorSize(real);
+}
+
+int uringDeviceCharacteristics(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int uringShmMap(sqlite3_file* file, int page, int pageSize, int extend, void volatile** out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmMap(real, page, pageSize, extend, out) : SQLITE_IOERR_SHMMAP;
+}
+
+//Read transaction in WAL mode starts by locking read mark, pages read ahead before may be checkpointed since
+int uringShmLock(sqlite3_file* file, int offset, int n, int flags)
+{
+	UringFile* f = uringFile(file);
+	if (f->state && (flags & SQLITE_SHM_LOCK))
+		f->state->invalidate();
+	sqlite3_file* real = f->real();
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmLock(real, offset, n, flags) : SQLITE_IOERR_SHMLOCK;
+}
+
+void uringShmBarrier(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	if (real->pMethods->iVersion >= 2)
+		real->pMethods->xShmBarrier(real);
+}
+
+int uringShmUnmap(sqlite3_file* file, int deleteFlag)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmUnmap(real, deleteFlag) : SQLITE_OK;
+}
+
+int uringFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** out)
+{
+	sqlite3_file* real = realFile(file);
+	if (real->pMethods->iVersion < 3) {
+		*out = nullptr;
+		return SQLITE_OK;
+	}
+	return real->pMethods->xFetch(real, offset, amount, out);
+}
+
+int uringUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 3 ? real->pMethods->xUnfetch(real, offset, page) : SQLITE_OK;
+}
+
+const sqlite3_io_methods uringMethods = {
+	3,
+	uringClose,
+	uringRead,
+	uringWrite,
+	uringTruncate,
+	uringSync,
+	uringFileSize,
+	uringLock,
+	uringUnlock,
+	uringCheckReservedLock,
+	uringFileControl,
+	uringSectorSize,
+	uringDeviceCharacteristics,
+	uringShmMap,
+	uringShmLock,
+	uringShmBarrier,
+	uringShmUnmap,
+	uringFetch,
+	uringUnfetch
+};
+
+//------------------------VFS methods-----------------------------//
+
+//Creates io_uring state of file, returns null if io_uring can't be used for it
+UringState* createState(const char* name, int flags)
+{
+	if (!available || !name || !(flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_WAL)))
+		return nullptr;
+
+	std::unique_ptr<UringState> state(new (std::nothrow) UringState());
+	if (!state || !state->ring.init(queueDepth))
+		return nullptr;
+
+	state->fd = acquireDescriptor(name, (flags & SQLITE_OPEN_READWRITE) != 0, state->key);
+	if (state->fd < 0)
+		return nullptr;
+	state->isWal = (flags & SQLITE_OPEN_WAL) != 0;
+	if (!state->isWal)
+		state->slots.resize(readaheadPages);
+	return state.release();
+}
+
+int uringOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags)
+{
+	UringFile* f = uringFile(file);
+	f->base.pMethods = nullptr;
+	f->state = nullptr;
+
+	int rc = realVfs()->xOpen(realVfs(), name, f->real(), flags, outFlags);
+	if (!f->real()->pMethods)
+		return rc;
+	f->base.pMethods = &uringMethods;
+	if (rc == SQLITE_OK)
+		f->state = createState(name, flags);
+	return rc;
+}
+
+int uringDelete(sqlite3_vfs*, const char* name, int syncDir)
+{
+	return realVfs()->xDelete(realVfs(), name, syncDir);
+}
+
+int uringAccess(sqlite3_vfs*, const char* name, int flags, int* out)
+{
+	return realVfs()->xAccess(realVfs(), name, flags, out);
+}
+
+int uringFullPathname(sqlite3_vfs*, const char* name, int size, char* out)
+{
+	return realVfs()->xFullPathname(realVfs(), name, size, out);
+}
+
+void* uringDlOpen(sqlite3_vfs*, const char* name)
+{
+	return realVfs()->xDlOpen(realVfs(), name);
+}
+
+void uringDlError(sqlite3_vfs*, int size, char* out)
+{
+	realVfs()->xDlError(realVfs(), size, out);
+}
+
+void (*uringDlSym(sqlite3_vfs*, void* handle, const char* symbol))(void)
+{
+	return realVfs()->xDlSym(realVfs(), handle, symbol);
+}
+
+void uringDlClose(sqlite3_vfs*, void* handle)
+{
+	realVfs()->xDlClose(realVfs(), handle);
+}
+
+int uringRandomness(sqlite3_vfs*, int size, char* out)
+{
+	return realVfs()->xRandomness(realVfs(), size, out);
+}
+
+int uringSleep(sqlite3_vfs*, int micros)
+{
+	return realVfs()->xSleep(realVfs(), micros);
+}
+
+int uringCurrentTime(sqlite3_vfs*, double* out)
+{
+	return realVfs()->xCurrentTime(realVfs(), out);
+}
+
+int uringGetLastError(sqlite3_vfs*, int size, char* out)
+{
+	return realVfs()->xGetLastError ? realVfs()->xGetLastError(realVfs(), size, out) : 0;
+}
+
+int uringCurrentTimeInt64(sqlite3_vfs*, sqlite3_int64* out)
+{
+	return realVfs()->xCurrentTimeInt64(realVfs(), out);
+}
+
+std::once_flag installed;
+
+} // namespace
+
+//------------------------UringVfs-----------------------------//
+
+const char* const UringVfs::name = "muring";
+
+const char* UringVfs::install(unsigned depth, unsigned readahead)
+{
+	std::call_once(installed, [depth, readahead] {
+		sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+		if (!real)
+			throw SQLite3Error("There is no default VFS to wrap");
+
+		queueDepth = std::max(depth, 4u);
+		readaheadPages = std::min(readahead, queueDepth / 2);
+
+		//Kernel without io_uring or with io_uring disabled by seccomp
+		Ring probe;
+		available = probe.init(queueDepth);
+
+		uringVfs.iVersion = real->iVersion >= 2 ? 2 : 1;
+		uringVfs.szOsFile = sizeof(UringFile) + real->szOsFile;
+		uringVfs.mxPathname = real->mxPathname;
+		uringVfs.zName = name;
+		uringVfs.pAppData = real;
+		uringVfs.xOpen = uringOpen;
+		uringVfs.xDelete = uringDelete;
+		uringVfs.xAccess = uringAccess;
+		uringVfs.xFullPathname = uringFullPathname;
+		uringVfs.xDlOpen = real->xDlOpen ? uringDlOpen : nullptr;
+		uringVfs.xDlError = real->xDlError ? uringDlError : nullptr;
+		uringVfs.xDlSym = real->xDlSym ? uringDlSym : nullptr;
+		uringVfs.xDlClose = real->xDlClose ? uringDlClose : nullptr;
+		uringVfs.xRandomness = uringRandomness;
+		uringVfs.xSleep = uringSleep;
+		uringVfs.xCurrentTime = uringCurrentTime;
+		uringVfs.xGetLastError = uringGetLastError;
+		if (uringVfs.iVersion >= 2)
+			uringVfs.xCurrentTimeInt64 = uringCurrentTimeInt64;
+
+		int rc = sqlite3_vfs_register(&uringVfs, 0);
+		if (rc != SQLITE_OK)
+			throw SQLite3Error(SQLite3ErrorInfo::fromCode(rc, std::string("VFS can't be registered: ") + sqlite3_errstr(rc)));
+	});
+	return name;
+}
+
+bool UringVfs::isAvailable()
+{
+	return available;
+}
+
+#else
+
+//------------------------UringVfs-----------------------------//
+
+//Without Linux there is no io_uring, default VFS is used
+const char* const UringVfs::name = nullptr;
+
+const char* UringVfs::install(unsigned, unsigned)
+{
+	return nullptr;
+}
+
+bool UringVfs::isAvailable()
+{
+	return false;
+}
+
+#endif
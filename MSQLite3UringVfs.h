@@ -0,0 +1,38 @@
+#ifndef MSQLite3UringVfsH
+#define MSQLite3UringVfsH
+#include "MSQLite3.h"
+
+//UringVfs is experimental Linux VFS which does reads, writes and syncs of main database and WAL file through io_uring
+//Locking, shared memory and all other files are handled by default VFS
+//When sequential scan is detected, following pages are read ahead in one submission,
+//frames written to WAL are queued and submitted together when commit frame is written or file is synced
+//If kernel does not support io_uring, VFS is still registered and works as default VFS
+//VFS keeps its own descriptor of file, shared by all its connections of the process and closed with the last of them,
+//because POSIX locks are released when any descriptor of file is closed
+//All connections of the process which open the same database should use this VFS,
+//otherwise closing of last connection of this VFS drops locks of connections of default VFS
+//Every open main database and WAL file has its own ring of [queueDepth] entries, which takes a descriptor
+//and locked kernel memory, so count of open connections is limited by RLIMIT_NOFILE and RLIMIT_MEMLOCK
+//Failure of queued WAL frame is reported by call which submits the queue, not by write of the frame itself:
+//by write of page of commit frame at latest, so transaction with failed frame is never committed
+//example
+/*
+	SQLite3 db("data.db", nullptr, UringVfs::install());
+*/
+class UringVfs
+{
+public:
+	//Name under which VFS is registered
+	static const char* const name;
+
+	//Registers VFS, parameters of first call are used
+	//[queueDepth] is count of entries of ring of each opened file
+	//[readaheadPages] is count of pages read ahead during sequential scan, 0 disables readahead
+	//Returns name of VFS so it can be passed directly to SQLite3 constructor
+	static const char* install(unsigned queueDepth = 64, unsigned readaheadPages = 16);
+
+	//Returns true if io_uring can be used, false if VFS falls back to default VFS
+	static bool isAvailable();
+};
+
+#endif
@@ -0,0 +1,415 @@
+#include "MSQLite3Vfs.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+//Counters of one kind of file, updated concurrently by all connections
+struct IoCounters
+{
+	std::atomic<uint64_t> reads{ 0 };
+	std::atomic<uint64_t> writes{ 0 };
+	std::atomic<uint64_t> syncs{ 0 };
+	std::atomic<uint64_t> bytesRead{ 0 };
+	std::atomic<uint64_t> bytesWritten{ 0 };
+	std::atomic<uint64_t> readNanos{ 0 };
+	std::atomic<uint64_t> writeNanos{ 0 };
+	std::atomic<uint64_t> syncNanos{ 0 };
+
+	void copyTo(IoMetrics& m) const
+	{
+		m.reads = reads.load(std::memory_order_relaxed);
+		m.writes = writes.load(std::memory_order_relaxed);
+		m.syncs = syncs.load(std::memory_order_relaxed);
+		m.bytesRead = bytesRead.load(std::memory_order_relaxed);
+		m.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+		m.readTime = std::chrono::nanoseconds(readNanos.load(std::memory_order_relaxed));
+		m.writeTime = std::chrono::nanoseconds(writeNanos.load(std::memory_order_relaxed));
+		m.syncTime = std::chrono::nanoseconds(syncNanos.load(std::memory_order_relaxed));
+	}
+
+	void clear()
+	{
+		for (auto* c : { &reads, &writes, &syncs, &bytesRead, &bytesWritten, &readNanos, &writeNanos, &syncNanos })
+			c->store(0, std::memory_order_relaxed);
+	}
+};
+
+IoCounters mainDbCounters, walCounters, journalCounters, otherCounters;
+
+//Measures duration of one I/O call
+class Stopwatch
+{
+	std::chrono::steady_clock::time_point start;
+public:
+	Stopwatch() :start(std::chrono::steady_clock::now()) {}
+
+	uint64_t nanos() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+//Opened file, file of wrapped VFS is allocated right behind this structure
+struct StatsFile
+{
+	sqlite3_file base;
+	IoCounters* counters;
+
+	sqlite3_file* real()
+	{
+		return reinterpret_cast<sqlite3_file*>(this + 1);
+	}
+};
+
+sqlite3_vfs statsVfs;
+
+sqlite3_vfs* realVfs()
+{
+	return static_cast<sqlite3_vfs*>(statsVfs.pAppData);
+}
+
+sqlite3_file* realFile(sqlite3_file* file)
+{
+	return reinterpret_cast<StatsFile*>(file)->real();
+}
+
+IoCounters& countersFor(int flags)
+{
+	if (flags & SQLITE_OPEN_MAIN_DB)
+		return mainDbCounters;
+	if (flags & SQLITE_OPEN_WAL)
+		return walCounters;
+	if (flags & SQLITE_OPEN_MAIN_JOURNAL)
+		return journalCounters;
+	return otherCounters;
+}
+
+//------------------------File methods-----------------------------//
+
+int statsClose(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods ? real->pMethods->xClose(real) : SQLITE_OK;
+}
+
+int statsRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset)
+{
+	StatsFile* f = reinterpret_cast<StatsFile*>(file);
+	Stopwatch sw;
+	int rc = f->real()->pMethods->xRead(f->real(), buffer, amount, offset);
+	f->counters->readNanos.fetch_add(sw.nanos(), std::memory_order_relaxed);
+	f->counters->reads.fetch_add(1, std::memory_order_relaxed);
+	if (rc == SQLITE_OK)
+		f->counters->bytesRead.fetch_add(amount, std::memory_order_relaxed);
+	return rc;
+}
+
+int statsWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset)
+{
+	StatsFile* f = reinterpret_cast<StatsFile*>(file);
+	Stopwatch sw;
+	int rc = f->real()->pMethods->xWrite(f->real(), buffer, amount, offset);
+	f->counters->writeNanos.fetch_add(sw.nanos(), std::memory_order_relaxed);
+	f->counters->writes.fetch_add(1, std::memory_order_relaxed);
+	if (rc == SQLITE_OK)
+		f->counters->bytesWritten.fetch_add(amount, std::memory_order_relaxed);
+	return rc;
+}
+
+int statsTruncate(sqlite3_file* file, sqlite3_int64 size)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xTruncate(real, size);
+}
+
+int statsSync(sqlite3_file* file, int flags)
+{
+	StatsFile* f = reinterpret_cast<StatsFile*>(file);
+	Stopwatch sw;
+	int rc = f->real()->pMethods->xSync(f->real(), flags);
+	f->counters->syncNanos.fetch_add(sw.nanos(), std::memory_order_relaxed);
+	f->counters->syncs.fetch_add(1, std::memory_order_relaxed);
+	return rc;
+}
+
+int statsFileSize(sqlite3_file* file, sqlite3_int64* size)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xFileSize(real, size);
+}
+
+int statsLock(sqlite3_file* file, int lock)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xLock(real, lock);
+}
+
+int statsUnlock(sqlite3_file* file, int lock)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xUnlock(real, lock);
+}
+
+int statsCheckReservedLock(sqlite3_file* file, int* out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xCheckReservedLock(real, out);
+}
+
+int statsFileControl(sqlite3_file* file, int op, void* arg)
+{
+	sqlite3_file* real = realFile(file);
+	int rc = real->pMethods->xFileControl(real, op, arg);
+
+	//Report VFS stack as e.g. minstrumented/unix
+	if (op == SQLITE_FCNTL_VFSNAME && rc == SQLITE_OK)
+		*static_cast<char**>(arg) = sqlite3_mprintf("%s/%z", InstrumentedVfs::name, *static_cast<char**>(arg));
+	return rc;
+}
+
+int statsSectorSize(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xSectorSize(real);
+}
+
+int statsDeviceCharacteristics(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->xDeviceCharacteristics(real);
+}
+
+int statsShmMap(sqlite3_file* file, int page, int pageSize, int extend, void volatile** out)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmMap(real, page, pageSize, extend, out) : SQLITE_IOERR_SHMMAP;
+}
+
+int statsShmLock(sqlite3_file* file, int offset, int n, int flags)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmLock(real, offset, n, flags) : SQLITE_IOERR_SHMLOCK;
+}
+
+void statsShmBarrier(sqlite3_file* file)
+{
+	sqlite3_file* real = realFile(file);
+	if (real->pMethods->iVersion >= 2)
+		real->pMethods->xShmBarrier(real);
+}
+
+int statsShmUnmap(sqlite3_file* file, int deleteFlag)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 2 ? real->pMethods->xShmUnmap(real, deleteFlag) : SQLITE_OK;
+}
+
+//Memory mapped pages are counted as reads of whole page without latency
+int statsFetch(sqlite3_file* file, sqlite3_int64 offset, int amount, void** out)
+{
+	StatsFile* f = reinterpret_cast<StatsFile*>(file);
+	sqlite3_file* real = f->real();
+	if (real->pMethods->iVersion < 3) {
+		*out = nullptr;
+		return SQLITE_OK;
+	}
+	int rc = real->pMethods->xFetch(real, offset, amount, out);
+	if (rc == SQLITE_OK && *out) {
+		f->counters->reads.fetch_add(1, std::memory_order_relaxed);
+		f->counters->bytesRead.fetch_add(amount, std::memory_order_relaxed);
+	}
+	return rc;
+}
+
+int statsUnfetch(sqlite3_file* file, sqlite3_int64 offset, void* page)
+{
+	sqlite3_file* real = realFile(file);
+	return real->pMethods->iVersion >= 3 ? real->pMethods->xUnfetch(real, offset, page) : SQLITE_OK;
+}
+
+const sqlite3_io_methods statsMethods = {
+	3,
+	statsClose,
+	statsRead,
+	statsWrite,
+	statsTruncate,
+	statsSync,
+	statsFileSize,
+	statsLock,
+	statsUnlock,
+	statsCheckReservedLock,
+	statsFileControl,
+	statsSectorSize,
+	statsDeviceCharacteristics,
+	statsShmMap,
+	statsShmLock,
+	statsShmBarrier,
+	statsShmUnmap,
+	statsFetch,
+	statsUnfetch
+};
+
+//------------------------VFS methods-----------------------------//
+
+int statsOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags)
+{
+	StatsFile* f = reinterpret_cast<StatsFile*>(file);
+	f->base.pMethods = nullptr;
+	f->counters = &countersFor(flags);
+
+	int rc = realVfs()->xOpen(realVfs(), name, f->real(), flags, outFlags);
+	if (f->real()->pMethods)
+		f->base.pMethods = &statsMethods;
+	return rc;
+}
+
+int statsDelete(sqlite3_vfs*, const char* name, int syncDir)
+{
+	return realVfs()->xDelete(realVfs(), name, syncDir);
+}
+
+int statsAccess(sqlite3_vfs*, const char* name, int flags, int* out)
+{
+	return realVfs()->xAccess(realVfs(), name, flags, out);
+}
+
+int statsFullPathname(sqlite3_vfs*, const char* name, int size, char* out)
+{
+	return realVfs()->xFullPathname(realVfs(), name, size, out);
+}
+
+void* statsDlOpen(sqlite3_vfs*, const char* name)
+{
+	return realVfs()->xDlOpen(realVfs(), name);
+}
+
+void statsDlError(sqlite3_vfs*, int size, char* out)
+{
+	realVfs()->xDlError(realVfs(), size, out);
+}
+
+void (*statsDlSym(sqlite3_vfs*, void* handle, const char* symbol))(void)
+{
+	return realVfs()->xDlSym(realVfs(), handle, symbol);
+}
+
+void statsDlClose(sqlite3_vfs*, void* handle)
+{
+	realVfs()->xDlClose(realVfs(), handle);
+}
+
+int statsRandomness(sqlite3_vfs*, int size, char* out)
+{
+	return realVfs()->xRandomness(realVfs(), size, out);
+}
+
+int statsSleep(sqlite3_vfs*, int micros)
+{
+	return realVfs()->xSleep(realVfs(), micros);
+}
+
+int statsCurrentTime(sqlite3_vfs*, double* out)
+{
+	return realVfs()->xCurrentTime(realVfs(), out);
+}
+
+int statsGetLastError(sqlite3_vfs*, int size, char* out)
+{
+	return realVfs()->xGetLastError ? realVfs()->xGetLastError(realVfs(), size, out) : 0;
+}
+
+int statsCurrentTimeInt64(sqlite3_vfs*, sqlite3_int64* out)
+{
+	return realVfs()->xCurrentTimeInt64(realVfs(), out);
+}
+
+int statsSetSystemCall(sqlite3_vfs*, const char* name, sqlite3_syscall_ptr call)
+{
+	return realVfs()->xSetSystemCall(realVfs(), name, call);
+}
+
+sqlite3_syscall_ptr statsGetSystemCall(sqlite3_vfs*, const char* name)
+{
+	return realVfs()->xGetSystemCall(realVfs(), name);
+}
+
+const char* statsNextSystemCall(sqlite3_vfs*, const char* name)
+{
+	return realVfs()->xNextSystemCall(realVfs(), name);
+}
+
+std::once_flag installed;
+std::atomic<bool> isRegistered{ false };
+
+} // namespace
+
+//------------------------InstrumentedVfs-----------------------------//
+
+const char* const InstrumentedVfs::name = "minstrumented";
+
+const char* InstrumentedVfs::install(bool makeDefault)
+{
+	std::call_once(installed, [] {
+		sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+		if (!real)
+			throw SQLite3Error("There is no default VFS to wrap");
+
+		//Methods missing in older versions of wrapped VFS are left empty
+		statsVfs.iVersion = real->iVersion < 3 ? real->iVersion : 3;
+		statsVfs.szOsFile = sizeof(StatsFile) + real->szOsFile;
+		statsVfs.mxPathname = real->mxPathname;
+		statsVfs.zName = name;
+		statsVfs.pAppData = real;
+		statsVfs.xOpen = statsOpen;
+		statsVfs.xDelete = statsDelete;
+		statsVfs.xAccess = statsAccess;
+		statsVfs.xFullPathname = statsFullPathname;
+		statsVfs.xDlOpen = real->xDlOpen ? statsDlOpen : nullptr;
+		statsVfs.xDlError = real->xDlError ? statsDlError : nullptr;
+		statsVfs.xDlSym = real->xDlSym ? statsDlSym : nullptr;
+		statsVfs.xDlClose = real->xDlClose ? statsDlClose : nullptr;
+		statsVfs.xRandomness = statsRandomness;
+		statsVfs.xSleep = statsSleep;
+		statsVfs.xCurrentTime = statsCurrentTime;
+		statsVfs.xGetLastError = statsGetLastError;
+		if (statsVfs.iVersion >= 2)
+			statsVfs.xCurrentTimeInt64 = statsCurrentTimeInt64;
+		if (statsVfs.iVersion >= 3) {
+			statsVfs.xSetSystemCall = statsSetSystemCall;
+			statsVfs.xGetSystemCall = statsGetSystemCall;
+			statsVfs.xNextSystemCall = statsNextSystemCall;
+		}
+
+		int rc = sqlite3_vfs_register(&statsVfs, 0);
+		if (rc != SQLITE_OK)
+			throw SQLite3Error(SQLite3ErrorInfo::fromCode(rc, std::string("VFS can't be registered: ") + sqlite3_errstr(rc)));
+		isRegistered = true;
+	});
+
+	if (makeDefault)
+		sqlite3_vfs_register(&statsVfs, 1);
+	return name;
+}
+
+bool InstrumentedVfs::isInstalled()
+{
+	return isRegistered;
+}
+
+void InstrumentedVfs::collect(SQLite3Metrics& metrics)
+{
+	mainDbCounters.copyTo(metrics.mainDb);
+	walCounters.copyTo(metrics.wal);
+	journalCounters.copyTo(metrics.journal);
+	otherCounters.copyTo(metrics.otherFiles);
+}
+
+void InstrumentedVfs::reset()
+{
+	mainDbCounters.clear();
+	walCounters.clear();
+	journalCounters.clear();
+	otherCounters.clear();
+}
@@ -0,0 +1,37 @@
+#ifndef MSQLite3VfsH
+#define MSQLite3VfsH
+#include "MSQLite3.h"
+
+//InstrumentedVfs is shim VFS which wraps default VFS of the process (unix on Linux)
+//and measures every read, write and sync done by SQLite, split by kind of file (main db, WAL, journal)
+//Counters are process wide and are part of SQLite3::metrics() snapshot
+//VFS is optional, it has to be installed before connection is opened and its name passed to SQLite3 constructor
+//example
+/*
+	SQLite3 db("data.db", nullptr, InstrumentedVfs::install());
+	...
+	SQLite3Metrics m = db.metrics();
+	std::cout << m.mainDb.bytesRead << " bytes read in " << m.mainDb.readTime.count() << " ns";
+*/
+class InstrumentedVfs
+{
+public:
+	//Name under which VFS is registered
+	static const char* const name;
+
+	//Registers VFS, can be called repeatedly and from more threads
+	//If [makeDefault] is true VFS is used also by connections which do not specify VFS
+	//Returns name of VFS so it can be passed directly to SQLite3 constructor
+	static const char* install(bool makeDefault = false);
+
+	//Returns true if install was called
+	static bool isInstalled();
+
+	//Copies counters into I/O part of metrics snapshot
+	static void collect(SQLite3Metrics& metrics);
+
+	//Sets all counters to zero
+	static void reset();
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "MShardedDatabase.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+//------------------------Shard-----------------------------//
+
+class ShardedDatabase::Shard
+{
+private:
+	struct Item {
+		Task task;
+		std::promise<void> done;
+	};
+
+	SQLite3 db;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Item> queue;
+	bool stopping;
+
+	//Started last so all other members are initialized
+	std::thread thread;
+
+	//Executes queued items in one transaction
+	//Promises are fulfilled only after commit so caller never sees write which was rolled back
+	void runBatch(std::deque<Item>& batch)
+	{
+		std::vector<std::exception_ptr> errors(batch.size());
+		const bool grouped = batch.size() > 1;
+
+		try {
+			if (grouped)
+				db.beginTransaction();
+		}
+		catch (...) {
+			for (auto& item : batch)
+				item.done.set_exception(std::current_exception());
+			return;
+		}
+
+		//Tasks behind failed statement which rolled back the transaction are not run,
+		//they would run in autocommit mode and their writes would stay although caller is told they failed
+		size_t ran = 0;
+		bool rolledBack = false;
+		while (ran < batch.size() && !rolledBack) {
+			try {
+				batch[ran].task(db);
+			}
+			catch (...) {
+				errors[ran] = std::current_exception();
+			}
+			++ran;
+			//Some errors (SQLITE_FULL, SQLITE_IOERR, SQLITE_BUSY, SQLITE_NOMEM) roll back whole transaction
+			rolledBack = grouped && !db.inTransaction();
+		}
+
+		std::exception_ptr batchError;
+		if (rolledBack) {
+			batchError = std::make_exception_ptr(SQLite3Error("Transaction was rolled back by failed statement"));
+			const auto skipped = std::make_exception_ptr(SQLite3Error("Task was not executed, transaction of its batch was rolled back"));
+			for (size_t i = ran; i < batch.size(); ++i)
+				errors[i] = skipped;
+		}
+		else if (grouped) {
+			try {
+				db.endTransaction();
+			}
+			catch (...) {
+				batchError = std::current_exception();
+				try {
+					db.execute("ROLLBACK");
+				}
+				catch (...) {
+				}
+			}
+		}
+
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (errors[i])
+				batch[i].done.set_exception(errors[i]);
+			else if (batchError)
+				batch[i].done.set_exception(batchError);
+			else
+				batch[i].done.set_value();
+		}
+	}
+
+	void run()
+	{
+		std::deque<Item> batch;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !queue.empty(); });
+				if (queue.empty())
+					return;
+				batch.swap(queue);
+			}
+			runBatch(batch);
+			batch.clear();
+		}
+	}
+public:
+	Shard(const std::string& path, const char* createStmt)
+		:
+		db(path.c_str(), createStmt),
+		stopping(false),
+		thread(&Shard::run, this)
+	{}
+
+	//Queue is drained before the thread ends
+	~Shard()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+
+	std::future<void> submit(Task task)
+	{
+		Item item{ std::move(task), std::promise<void>() };
+		auto rval = item.done.get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+				throw SQLite3Error("Shard is closing");
+			queue.emplace_back(std::move(item));
+		}
+		wake.notify_one();
+		return rval;
+	}
+};
+
+//------------------------ShardedDatabase-----------------------------//
+
+ShardedDatabase::ShardedDatabase(const std::vector<std::string>& paths, const char* createStmt)
+	:paths(paths)
+{
+	if (paths.empty())
+		throw SQLite3Error("Sharded database needs at least one shard");
+
+	shards.reserve(paths.size());
+	for (auto& path : paths)
+		shards.emplace_back(new Shard(path, createStmt));
+}
+
+ShardedDatabase::~ShardedDatabase()
+{
+}
+
+size_t ShardedDatabase::shardCount() const
+{
+	return shards.size();
+}
+
+std::future<void> ShardedDatabase::submit(size_t shard, Task task)
+{
+	if (shard >= shards.size())
+		throw SQLite3Error("There is no shard with index: " + std::to_string(shard));
+	return shards[shard]->submit(std::move(task));
+}
+
+void ShardedDatabase::attachTo(SQLite3& db, const std::string& prefix) const
+{
+	for (size_t i = 0; i < paths.size(); ++i) {
+		//Quote path as sql string literal
+		std::string path;
+		for (char c : paths[i])
+			path += c == '\'' ? std::string("''") : std::string(1, c);
+
+		std::string sql = "ATTACH DATABASE '" + path + "' AS \"" + prefix + std::to_string(i) + "\"";
+		db.execute(sql.c_str());
+	}
+}
+
+void ShardedDatabase::wait(std::vector<std::future<void>>& done)
+{
+	std::exception_ptr error;
+	for (auto& f : done) {
+		try {
+			f.get();
+		}
+		catch (...) {
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
@@ -0,0 +1,183 @@
+#ifndef MShardedDatabaseH
+#define MShardedDatabaseH
+#include "MSQLite3.h"
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+//Fixed hash of shard keys, 64-bit FNV-1a over bytes of key
+//Integral keys are hashed as 8 bytes of their value in little-endian order, so 5 and int64_t(5) go to the same shard
+//Strings are hashed by their characters, other key types need overload of shardKeyHash found by argument-dependent lookup
+inline uint64_t shardKeyHash(const char* data, size_t size)
+{
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+		h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+	return h;
+}
+
+inline uint64_t shardKeyHash(const std::string& key)
+{
+	return shardKeyHash(key.data(), key.size());
+}
+
+inline uint64_t shardKeyHash(const char* key)
+{
+	return shardKeyHash(key, std::strlen(key));
+}
+
+template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+uint64_t shardKeyHash(T key)
+{
+	const uint64_t value = static_cast<uint64_t>(static_cast<int64_t>(key));
+	char bytes[8];
+	for (int i = 0; i < 8; ++i)
+		bytes[i] = static_cast<char>(value >> (8 * i));
+	return shardKeyHash(bytes, sizeof(bytes));
+}
+
+//ShardedDatabase splits one logical database over several database files (shards)
+//Every shard has its own SQLite3 connection and its own writer thread, so writes to different shards
+//do not contend for the same writer lock and write throughput grows with the count of shards
+//Row is owned by shard selected by hash of its key: shardFor(key) = shardKeyHash(key) % shardCount()
+//shardKeyHash is 64-bit FNV-1a, which does not depend on standard library or build, so rows of persistent shards
+//stay where they were written, see shardKeyHash for supported key types
+//Statements are queued to the owning shard and executed on its thread with statements cached per shard,
+//all statements waiting in the queue are committed together in one transaction
+//Reads can be routed to one shard by key or scattered over all shards and gathered into one ResultSet
+//example
+/*
+	ShardedDatabase db({ "user0.db", "user1.db", "user2.db" },
+		"CREATE TABLE IF NOT EXISTS User(id INTEGER PRIMARY KEY, name TEXT)");
+
+	db.execute(id, "INSERT INTO User(id,name) VALUES(?,?)", id, name).get();
+
+	auto rs = db.queryAll("SELECT id,name FROM User WHERE name LIKE ?", "A%");
+*/
+class ShardedDatabase
+{
+public:
+	//Work executed on thread of shard with connection of shard
+	typedef std::function<void(SQLite3&)> Task;
+private:
+	//Connection, queue and writer thread of one shard, defined in MShardedDatabase.cpp
+	class Shard;
+
+	//Paths to database files in order of shards
+	std::vector<std::string> paths;
+
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	//Parameters are executed asynchronously so they have to be owned by the queued task
+	//Character pointers are copied into strings, other types are stored by value
+	template<typename T>
+	using Owned = typename std::conditional<
+		std::is_same<typename std::decay<T>::type, const char*>::value
+		|| std::is_same<typename std::decay<T>::type, char*>::value,
+		std::string, typename std::decay<T>::type>::type;
+
+	//Creates task which binds stored parameters to cached statement and passes it to action
+	template<typename Action, typename ...Args>
+	static Task bindTask(const std::string& query, Action action, Args&&... args)
+	{
+		auto params = std::make_tuple(Owned<Args>(std::forward<Args>(args))...);
+		return [query, action, params](SQLite3& db) mutable {
+			PreparedStatement& ps = db.cachedStatement(query);
+			apply(ps, params, std::make_index_sequence<std::tuple_size<decltype(params)>::value>());
+			action(ps);
+		};
+	}
+
+	template<typename Tuple, size_t ...I>
+	static void apply(PreparedStatement& ps, Tuple& params, std::index_sequence<I...>)
+	{
+		ps.bind(std::get<I>(params)...);
+	}
+public:
+	//Opens all shard databases and starts their threads
+	//[createStmt] is executed on every shard, see SQLite3 constructor
+	ShardedDatabase(const std::vector<std::string>& paths, const char* createStmt = nullptr);
+
+	//Executes all queued tasks, stops threads and closes connections
+	~ShardedDatabase();
+
+	ShardedDatabase(const ShardedDatabase&) = delete;
+	ShardedDatabase& operator=(const ShardedDatabase&) = delete;
+
+	//Returns count of shards
+	size_t shardCount() const;
+
+	//Returns index of shard owning given key
+	//Character pointers are hashed by content not by address
+	template<typename Key>
+	size_t shardFor(const Key& key) const {
+		return static_cast<size_t>(shardKeyHash(key) % shards.size());
+	}
+
+	//Queues task on given shard
+	//Returned future is set after transaction containing the task is committed
+	//and carries exception thrown by the task or by the commit
+	std::future<void> submit(size_t shard, Task task);
+
+	//Executes statement on shard owning the key
+	//Parameters have the same meaning as in SQLite3::createPreparedStatement, nullptr binds NULL
+	template<typename Key, typename ...Args>
+	std::future<void> execute(const Key& key, const std::string& query, Args&&... args)
+	{
+		return submit(shardFor(key), bindTask(query, [](PreparedStatement& ps) { ps.execute(); }, std::forward<Args>(args)...));
+	}
+
+	//Executes statement on every shard, usable for schema changes
+	//Waits for all shards and rethrows first error
+	template<typename ...Args>
+	void executeAll(const std::string& query, Args&&... args)
+	{
+		std::vector<std::future<void>> done;
+		for (size_t i = 0; i < shards.size(); ++i)
+			done.push_back(submit(i, bindTask(query, [](PreparedStatement& ps) { ps.execute(); }, args...)));
+		wait(done);
+	}
+
+	//Executes query on shard owning the key
+	template<typename Key, typename ...Args>
+	ResultSet query(const Key& key, const std::string& query, Args&&... args)
+	{
+		ResultSet rval;
+		submit(shardFor(key), bindTask(query, [&rval](PreparedStatement& ps) { rval = ps.executeQuery(); },
+			std::forward<Args>(args)...)).get();
+		return rval;
+	}
+
+	//Executes query on all shards in parallel and merges their results in order of shards
+	//Ordering and aggregation over the merged rows is up to the caller
+	template<typename ...Args>
+	ResultSet queryAll(const std::string& query, Args&&... args)
+	{
+		std::vector<ResultSet> parts(shards.size());
+		std::vector<std::future<void>> done;
+		for (size_t i = 0; i < shards.size(); ++i) {
+			ResultSet* part = &parts[i];
+			done.push_back(submit(i, bindTask(query, [part](PreparedStatement& ps) { *part = ps.executeQuery(); }, args...)));
+		}
+		wait(done);
+
+		ResultSet rval;
+		for (auto& part : parts)
+			rval.merge(std::move(part));
+		return rval;
+	}
+
+	//Attaches all shard files to given connection as schemas [prefix]0 .. [prefix]N-1
+	//so ad-hoc queries can join over shards, e.g. SELECT * FROM shard0.User UNION ALL SELECT * FROM shard1.User
+	//Count of attached databases is limited by SQLITE_MAX_ATTACHED (10 by default)
+	void attachTo(SQLite3& db, const std::string& prefix = "shard") const;
+
+private:
+	//Waits for all futures and rethrows first error
+	static void wait(std::vector<std::future<void>>& done);
+};
+
+#endif
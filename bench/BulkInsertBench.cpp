@@ -0,0 +1,21 @@
+#include "MSQLite3Bench.h"
+#include "MSQLite3BulkInsert.h"
+#include <string>
+#include <tuple>
+#include <vector>
+
+//300k rows of (int, text, real) inserted into in-memory database by BulkInsert with K rows per statement
+
+int main()
+{
+	std::vector<std::tuple<int, std::string, double>> rows;
+	for (int i = 0; i < 300000; ++i)
+		rows.emplace_back(i, "name" + std::to_string(i), i * 0.5);
+	for (size_t rowsPerStatement : { 1, 10, 100, 256 }) {
+		SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT, score REAL)");
+		BulkInsert<int, std::string, double> insert(db, "T", { "id", "name", "score" }, rowsPerStatement);
+		const auto start = BenchClock::now();
+		insert(rows);
+		std::printf("K=%-4zu %5lld ms\n", insert.rowsPerStatement(), millisecondsSince(start));
+	}
+}
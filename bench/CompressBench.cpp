@@ -0,0 +1,49 @@
+#include "MSQLite3Bench.h"
+#include "MSQLite3CompressVfs.h"
+#include <string>
+
+//Size of database file and throughput of full table scan, CompressedVfs against default VFS
+//15k rows of text are inserted, every row is then updated once, which leaves dead page records in compressed file
+
+namespace {
+
+const int rows = 15000;
+
+void fill(const char* path, const char* vfs)
+{
+	removeDatabase(path);
+	SQLite3 db(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+	db.beginTransaction();
+	auto insert = db.createPreparedStatement("INSERT INTO T(b) VALUES(?)");
+	for (int i = 0; i < rows; ++i)
+		insert.reset().bind("some quite compressible text of row " + std::to_string(i % 100) + " lorem ipsum dolor sit amet, consectetur adipiscing elit").execute();
+	db.endTransaction();
+	db.execute("UPDATE T SET b = upper(b)");
+}
+
+//Returns MB/s of repeated scans with small page cache, so pages are read through VFS
+double scan(const char* path, const char* vfs)
+{
+	SQLite3 db(path, nullptr, vfs);
+	db.execute("PRAGMA cache_size=16");
+	long long bytes = 0;
+	const auto time = bestOf(5, [&] {
+		bytes = db.executeQuery("SELECT sum(length(b)) s FROM T").get<long long>("s");
+	});
+	return bytes / 1e6 / std::chrono::duration<double>(time).count();
+}
+
+}
+
+int main()
+{
+	const char* vfs = CompressedVfs::install();
+	fill("plain.db", nullptr);
+	fill("compressed.db", vfs);
+	std::printf("plain        %10lld bytes, scan %7.1f MB/s\n", fileSize("plain.db"), scan("plain.db", nullptr));
+	std::printf("compressed   %10lld bytes, scan %7.1f MB/s\n", fileSize("compressed.db"), scan("compressed.db", vfs));
+	const long long saved = CompressedVfs::compact("compressed.db");
+	std::printf("compacted    %10lld bytes, scan %7.1f MB/s, compact saved %lld bytes\n", fileSize("compressed.db"), scan("compressed.db", vfs), saved);
+	removeDatabase("plain.db");
+	removeDatabase("compressed.db");
+}
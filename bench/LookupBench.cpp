@@ -0,0 +1,39 @@
+#include "MSQLite3Bench.h"
+
+//Prepared statement loops of reset, bind and forEachRow or execute, best of 3 rounds of 2M operations
+
+int main()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER PRIMARY KEY, v INTEGER)");
+	db.execute("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x<100000) INSERT INTO T SELECT x, x*2 FROM s");
+	const int operations = 2000000;
+	long long sum = 0;
+
+	auto select = db.createPreparedStatement("SELECT ?");
+	const auto selectTime = bestOf(3, [&] {
+		for (int i = 0; i < operations; ++i) {
+			select.reset().bind(i);
+			select.forEachRow([&](sqlite3_stmt* stmt) { sum += sqlite3_column_int64(stmt, 0); });
+		}
+	});
+
+	auto lookup = db.createPreparedStatement("SELECT v FROM T WHERE id = ?");
+	const auto lookupTime = bestOf(3, [&] {
+		for (int i = 0; i < operations; ++i) {
+			lookup.reset().bind(i % 100000 + 1);
+			lookup.forEachRow([&](sqlite3_stmt* stmt) { sum += sqlite3_column_int64(stmt, 0); });
+		}
+	});
+
+	auto update = db.createPreparedStatement("UPDATE T SET v = v + 1 WHERE id = ?");
+	db.beginTransaction();
+	const auto updateTime = bestOf(3, [&] {
+		for (int i = 0; i < operations; ++i)
+			update.reset().bind(i % 100000 + 1).execute();
+	});
+	db.endTransaction();
+
+	std::printf("SELECT ?                     %5lld ns/op\n", nanosecondsPer(selectTime, operations));
+	std::printf("point lookup by primary key  %5lld ns/op\n", nanosecondsPer(lookupTime, operations));
+	std::printf("update by primary key        %5lld ns/op (checksum %lld)\n", nanosecondsPer(updateTime, operations), sum);
+}
@@ -0,0 +1,49 @@
+#ifndef MSQLite3BenchH
+#define MSQLite3BenchH
+#include "MSQLite3.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+//Helpers of benchmark programs, every program prints its results to standard output
+//Numbers quoted in commit messages come from these programs built in Release mode
+
+typedef std::chrono::steady_clock BenchClock;
+
+//Returns shortest of [rounds] runs of [body]
+template<typename F>
+std::chrono::nanoseconds bestOf(int rounds, F body)
+{
+	std::chrono::nanoseconds best = std::chrono::nanoseconds::max();
+	for (int round = 0; round < rounds; ++round) {
+		const auto start = BenchClock::now();
+		body();
+		best = std::min<std::chrono::nanoseconds>(best, BenchClock::now() - start);
+	}
+	return best;
+}
+
+inline long long millisecondsSince(BenchClock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(BenchClock::now() - start).count();
+}
+
+inline long long nanosecondsPer(std::chrono::nanoseconds time, long long operations)
+{
+	return time.count() / std::max(1LL, operations);
+}
+
+//Removes database file with its journal, WAL and shared memory files
+inline void removeDatabase(const std::string& path)
+{
+	for (const char* suffix : { "", "-journal", "-wal", "-shm" })
+		std::remove((path + suffix).c_str());
+}
+
+inline long long fileSize(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+}
+
+#endif
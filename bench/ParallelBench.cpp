@@ -0,0 +1,33 @@
+#include "MSQLite3Bench.h"
+#include <string>
+#include <vector>
+
+//Decoding 1M rows of ResultSet into structs by ResultSet::transform with 1, 2 and 4 threads
+
+namespace {
+
+struct Item
+{
+	long long id;
+	std::string name;
+	double value;
+};
+
+}
+
+int main()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT, v REAL)");
+	db.execute("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<1000000) INSERT INTO T SELECT x, 'name'||x, x*0.5 FROM c");
+	ResultSet rs = db.executeQuery("SELECT * FROM T");
+	std::printf("hardware threads %u\n", std::thread::hardware_concurrency());
+	for (unsigned threads : { 1u, 2u, 4u }) {
+		size_t decoded = 0;
+		const auto time = bestOf(3, [&] {
+			decoded = rs.transform([](const ResultRow& row) {
+				return Item{ row.get<long long>("id"), row.get<std::string>("name"), row.get<double>("v") };
+			}, threads).size();
+		});
+		std::printf("%u threads %5lld ms, %zu rows\n", threads, static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(time).count()), decoded);
+	}
+}
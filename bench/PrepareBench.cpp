@@ -0,0 +1,15 @@
+#include "MSQLite3Bench.h"
+
+//Preparation of statement with 10 result columns, best of 5 rounds of 20k preparations
+
+int main()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(c0 INTEGER PRIMARY KEY, c1 TEXT NOT NULL, c2 REAL, c3 BLOB, c4 INT, "
+		"c5 TEXT COLLATE NOCASE, c6 INT, c7 INT, c8 TEXT, c9 REAL)");
+	const int preparations = 20000;
+	const auto time = bestOf(5, [&] {
+		for (int i = 0; i < preparations; ++i)
+			db.createPreparedStatement("SELECT c0, c1, c2, c3, c4, c5, c6, c7, c8, c9 FROM T WHERE c0 = ?", i);
+	});
+	std::printf("prepare %lld ns\n", nanosecondsPer(time, preparations));
+}
@@ -0,0 +1,22 @@
+#include "MSQLite3Bench.h"
+
+//Cost of statement statistics and timing on prepared "SELECT ?" loop, best of 15 rounds of 1M executions
+
+int main()
+{
+	SQLite3 db(":memory:");
+	const int executions = 1000000;
+	long long sum = 0;
+	for (bool timing : { false, true }) {
+		auto ps = db.createPreparedStatement("SELECT ?");
+		ps.timing(timing);
+		const auto time = bestOf(15, [&] {
+			for (int i = 0; i < executions; ++i) {
+				ps.reset().bind(i);
+				ps.forEachRow([&](sqlite3_stmt* stmt) { sum += sqlite3_column_int64(stmt, 0); });
+			}
+		});
+		std::printf("statistics%-9s %4lld ns/op\n", timing ? " + timing" : "", nanosecondsPer(time, executions));
+	}
+	std::printf("checksum %lld\n", sum);
+}
@@ -0,0 +1,38 @@
+#include "MSQLite3Bench.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//4000 single-row update transactions by SQLite3::transaction in WAL mode, spread over 1 and 4 writer threads
+
+int main()
+{
+	const int transactions = 4000;
+	for (int writers : { 1, 4 }) {
+		removeDatabase("transaction.db");
+		{
+			SQLite3 db("transaction.db", "CREATE TABLE C(id INTEGER PRIMARY KEY, v INTEGER)");
+			db.execute("PRAGMA journal_mode=WAL");
+			db.execute("WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM s WHERE x<64) INSERT INTO C SELECT x, 0 FROM s");
+		}
+		std::atomic<long long> retries{ 0 };
+		const auto start = BenchClock::now();
+		std::vector<std::thread> threads;
+		for (int writer = 0; writer < writers; ++writer)
+			threads.emplace_back([&, writer] {
+				SQLite3 db("transaction.db");
+				db.execute("PRAGMA synchronous=NORMAL");
+				auto update = db.createPreparedStatement("UPDATE C SET v = v + 1 WHERE id = ?");
+				for (int i = 0; i < transactions / writers; ++i)
+					db.transaction([&] {
+						update.reset().bind(writer * 16 + i % 16 + 1).execute();
+					}, 1000);
+				retries += db.metrics().transactionRetries;
+			});
+		for (auto& thread : threads)
+			thread.join();
+		const long long ms = std::max(1LL, millisecondsSince(start));
+		std::printf("%d writers %5lld ms, %6lld tx/s, %lld retries\n", writers, ms, transactions * 1000LL / ms, retries.load());
+	}
+	removeDatabase("transaction.db");
+}
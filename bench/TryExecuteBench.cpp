@@ -0,0 +1,33 @@
+#include "MSQLite3Bench.h"
+
+//200k inserts of which 199k fail on UNIQUE constraint, throwing execute against tryExecute
+
+int main()
+{
+	const int inserts = 200000;
+	for (bool throwing : { true, false }) {
+		SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)");
+		db.beginTransaction();
+		auto ps = db.createPreparedStatement("INSERT INTO T VALUES(?, ?)");
+		int failures = 0;
+		const auto start = BenchClock::now();
+		for (int i = 0; i < inserts; ++i) {
+			if (throwing) {
+				try {
+					ps.reset().bind(i % 1000, "x").execute();
+				}
+				catch (const SQLite3Error&) {
+					++failures;
+				}
+			}
+			else {
+				ps.tryReset();
+				if (ps.tryBind(i % 1000, "x") != SQLITE_OK || ps.tryExecute() != SQLITE_OK)
+					++failures;
+			}
+		}
+		const long long ms = millisecondsSince(start);
+		db.endTransaction();
+		std::printf("%-10s %5lld ms, %d failed\n", throwing ? "execute" : "tryExecute", ms, failures);
+	}
+}
@@ -0,0 +1,41 @@
+#include "MSQLite3Bench.h"
+#include "MSQLite3UringVfs.h"
+#include <string>
+
+//40k inserts in 20 transactions, after every transaction rows are counted by second connection,
+//then table is scanned with small page cache, UringVfs against default VFS in WAL and DELETE modes
+
+int main()
+{
+	const char* uring = UringVfs::install();
+	std::printf("io_uring %s\n", UringVfs::isAvailable() ? "available" : "not available, UringVfs works as default VFS");
+	for (const char* journalMode : { "WAL", "DELETE" })
+		for (const char* vfs : { static_cast<const char*>(nullptr), uring }) {
+			removeDatabase("uring.db");
+			long long writeMs, scanMs;
+			{
+				SQLite3 db("uring.db", "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+				db.execute((std::string("PRAGMA journal_mode=") + journalMode).c_str());
+				SQLite3 reader("uring.db", nullptr, vfs);
+				auto insert = db.createPreparedStatement("INSERT INTO T(b) VALUES(?)");
+				const auto start = BenchClock::now();
+				for (int transaction = 0; transaction < 20; ++transaction) {
+					db.beginTransaction();
+					for (int i = 0; i < 2000; ++i)
+						insert.reset().bind(std::string(200, 'a' + i % 26)).execute();
+					db.endTransaction();
+					if (reader.executeQuery("SELECT count(*) c FROM T").get<int>("c") != (transaction + 1) * 2000)
+						std::printf("count mismatch\n");
+				}
+				writeMs = millisecondsSince(start);
+
+				reader.execute("PRAGMA cache_size=10");
+				const auto scanStart = BenchClock::now();
+				for (int round = 0; round < 5; ++round)
+					reader.executeQuery("SELECT sum(length(b)) s FROM T");
+				scanMs = millisecondsSince(scanStart);
+			}
+			std::printf("%-7s %-6s inserts %5lld ms, 5 scans %5lld ms\n", vfs ? "uring" : "default", journalMode, writeMs, scanMs);
+		}
+	removeDatabase("uring.db");
+}
@@ -0,0 +1,134 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3Arrow.h"
+#include <string>
+
+namespace {
+
+const char* const table = "CREATE TABLE T(id INTEGER, name TEXT, v REAL, b BLOB)";
+
+//Rows with NULL in every column except id, empty text and blob
+void fill(SQLite3& db, int rows)
+{
+	db.execute(("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<" + std::to_string(rows) + ") "
+		"INSERT INTO T SELECT x, CASE WHEN x%7 THEN 'n'||x END, CASE WHEN x%5 THEN x*0.5 END, "
+		"CASE WHEN x%3 = 1 THEN x'00ff' WHEN x%3 = 2 THEN x'' END FROM c").c_str());
+}
+
+void testBatchReader()
+{
+	SQLite3 db(":memory:", table);
+	fill(db, 2500);
+	auto ps = db.createPreparedStatement("SELECT id, name, v FROM T");
+	BatchReader reader(ps, 1000);
+	size_t rows = 0, batches = 0, nullNames = 0;
+	int64_t ids = 0;
+	while (reader.next()) {
+		const ColumnBatch& batch = reader.batch();
+		CHECK(batch.width() == 3);
+		CHECK(batch.column(0).type == ColumnType::Integer);
+		for (size_t row = 0; row < batch.size(); ++row)
+			ids += batch.column(0).integers[row];
+		nullNames += batch.column("name").nullCount;
+		if (batches == 0)
+			CHECK(batch.column(1).text(0) == "n1" && batch.column(1).isNull(6));
+		rows += batch.size();
+		++batches;
+	}
+	CHECK(rows == 2500 && batches == 3);
+	CHECK(ids == 2500 * 2501 / 2);
+	CHECK(nullNames == 2500 / 7);
+	CHECK(ps.stats().executions == 1 && ps.stats().rows == 2500);
+}
+
+void testBatchReaderInterrupted()
+{
+	SQLite3 db(":memory:", table);
+	fill(db, 1000);
+
+	auto endless = db.createPreparedStatement("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c) SELECT x FROM c");
+	endless.timeout(std::chrono::milliseconds(20));
+	BatchReader slow(endless, 1 << 20);
+	bool timedOut = false;
+	try {
+		while (slow.next()) {}
+	}
+	catch (const QueryTimeout&) {
+		timedOut = true;
+	}
+	CHECK(timedOut);
+
+	CancellationToken token;
+	auto ps = db.createPreparedStatement("SELECT id FROM T");
+	ps.cancelWith(token);
+	BatchReader reader(ps, 100);
+	CHECK(reader.next());
+	token.cancel();
+	bool cancelled = false;
+	try {
+		while (reader.next()) {}
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	CHECK(cancelled);
+
+	const SQLite3Metrics metrics = db.metrics();
+	CHECK(metrics.timeouts == 1 && metrics.cancellations == 1);
+}
+
+void testArrowRoundTrip()
+{
+	SQLite3 src(":memory:", table);
+	fill(src, 25000);
+	SQLite3 dst(":memory:", table);
+	auto ps = src.createPreparedStatement("SELECT * FROM T");
+	ArrowExporter exporter(ps, 10000);
+	ArrowArray array;
+	ArrowSchema schema;
+	size_t imported = 0;
+	while (exporter.next(&array)) {
+		exporter.schema(&schema);
+		CHECK(schema.n_children == 4);
+		CHECK(std::string(schema.children[0]->format) == "l" && std::string(schema.children[1]->format) == "u");
+		ArrowImportOptions options;
+		options.rowsPerTransaction = 4000;
+		imported += ArrowImporter::import(dst, "T", &schema, &array, options);
+		array.release(&array);
+		schema.release(&schema);
+	}
+	CHECK(imported == 25000);
+	CHECK(!dst.inTransaction());
+
+	const char* const summary = "SELECT count(*) c, sum(id) s, count(name) nn, sum(length(name)) nl, sum(v) v, count(v) nv, "
+		"count(b) nb, sum(length(b)) bl FROM T";
+	ResultSet expected = src.executeQuery(summary);
+	ResultSet actual = dst.executeQuery(summary);
+	for (const char* column : { "c", "s", "nn", "nl", "nv", "nb", "bl" })
+		CHECK(expected.get<long>(column) == actual.get<long>(column));
+	CHECK(expected.get<double>("v") == actual.get<double>("v"));
+	CHECK(dst.executeQuery("SELECT count(*) c FROM T WHERE typeof(b) = 'blob' AND length(b) = 0").get<long>("c") == 25000 / 3);
+}
+
+void testArrowEmptyResult()
+{
+	SQLite3 db(":memory:", table);
+	auto ps = db.createPreparedStatement("SELECT * FROM T WHERE 0");
+	ArrowExporter exporter(ps);
+	ArrowArray array;
+	ArrowSchema schema;
+	CHECK(!exporter.next(&array));
+	exporter.schema(&schema);
+	CHECK(schema.n_children == 4);
+	schema.release(&schema);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testBatchReader);
+	RUN_TEST(testBatchReaderInterrupted);
+	RUN_TEST(testArrowRoundTrip);
+	RUN_TEST(testArrowEmptyResult);
+	return testResult();
+}
@@ -0,0 +1,112 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3BulkInsert.h"
+#include "MSQLite3Table.h"
+#include "MSQLite3Upsert.h"
+#include "MShardedDatabase.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+const int64_t big = 5000000000LL;
+
+int64_t stored(SQLite3& db, const char* sql)
+{
+	int64_t value = 0;
+	db.createPreparedStatement(sql).forEachRow([&](sqlite3_stmt* stmt) { value = sqlite3_column_int64(stmt, 0); });
+	return value;
+}
+
+void testBind()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(v INTEGER)");
+	auto insert = db.createPreparedStatement("INSERT INTO T VALUES(?)");
+	insert.bind(big).execute();
+	CHECK(stored(db, "SELECT max(v) FROM T") == big);
+
+	insert.reset().bind(INT64_MIN).execute();
+	CHECK(stored(db, "SELECT min(v) FROM T") == INT64_MIN);
+
+	const uint32_t unsignedValue = 4000000000u;
+	db.execute("DELETE FROM T");
+	insert.reset().bind(unsignedValue).execute();
+	CHECK(stored(db, "SELECT v FROM T") == 4000000000LL);
+
+	const long long longLong = -big;
+	const unsigned short small = 65535;
+	db.execute("DELETE FROM T");
+	insert.reset().bind(longLong).execute();
+	insert.reset().bind(small).execute();
+	CHECK(stored(db, "SELECT min(v) FROM T") == -big);
+	CHECK(stored(db, "SELECT max(v) FROM T") == 65535);
+
+	CHECK(db.createPreparedStatement("SELECT ? v", big).executeQuery().get<int64_t>("v") == big);
+}
+
+void testBulkInsertAndUpsert()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER PRIMARY KEY, v INTEGER)");
+	std::vector<std::tuple<int64_t, int64_t>> rows;
+	for (int64_t i = 0; i < 250; ++i)
+		rows.emplace_back(big + i, -big - i);
+	BulkInsert<int64_t, int64_t> insert(db, "T", { "id", "v" }, 100);
+	CHECK(insert(rows) == 250);
+	CHECK(stored(db, "SELECT count(*) FROM T WHERE v = -id") == 250);
+	CHECK(stored(db, "SELECT min(id) FROM T") == big);
+
+	Upsert<int64_t, int64_t> upsert(db, "T", { "id", "v" }, { "id" });
+	CHECK(upsert(big, big) == UpsertResult::Updated);
+	CHECK(upsert(big, big) == UpsertResult::Unchanged);
+	CHECK(upsert(-big, big) == UpsertResult::Inserted);
+	CHECK(stored(db, "SELECT v FROM T WHERE id = 5000000000") == big);
+
+	for (auto& row : rows)
+		std::get<1>(row) = std::get<0>(row) * 2;
+	MergeResult merged = upsert.merge(rows);
+	CHECK(merged.updated == 250 && merged.unchanged == 0 && merged.inserted == 0);
+	CHECK(stored(db, "SELECT count(*) FROM T WHERE v = 2 * id") == 250);
+}
+
+struct Account
+{
+	int64_t id;
+	std::string owner;
+	int64_t balance;
+};
+
+void testTable()
+{
+	SQLite3 db(":memory:");
+	Table accounts(db, "Account", 1, column("id", &Account::id), column("owner", &Account::owner), column("balance", &Account::balance));
+	accounts.create();
+	accounts.insert({ big, "Alice", -big });
+	std::optional<Account> alice = accounts.find(big);
+	CHECK(alice && alice->owner == "Alice" && alice->balance == -big);
+	CHECK(accounts.update({ big, "Alice", big * 3 }));
+	CHECK(stored(db, "SELECT balance FROM Account") == big * 3);
+	CHECK(accounts.where("balance > ?", big).size() == 1);
+}
+
+void testShardedDatabase()
+{
+	TestDatabase first("bind_test_0.db"), second("bind_test_1.db");
+	{
+		ShardedDatabase shards({ first.c_str(), second.c_str() }, "CREATE TABLE T(id INTEGER PRIMARY KEY, v INTEGER)");
+		shards.execute(big, "INSERT INTO T VALUES(?, ?)", big, -big).get();
+		CHECK(shards.query(big, "SELECT v FROM T WHERE id = ?", big).get<int64_t>("v") == -big);
+	}
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testBind);
+	RUN_TEST(testBulkInsertAndUpsert);
+	RUN_TEST(testTable);
+	RUN_TEST(testShardedDatabase);
+	return testResult();
+}
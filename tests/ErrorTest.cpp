@@ -0,0 +1,135 @@
+#include "MSQLite3Test.h"
+#include <chrono>
+#include <string>
+
+namespace {
+
+const char* const table = "CREATE TABLE T(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE)";
+
+void testErrorInfo()
+{
+	SQLite3 db(":memory:", table);
+	db.execute("INSERT INTO T VALUES(1, 'a')");
+	bool thrown = false;
+	try {
+		db.createPreparedStatement("INSERT INTO T VALUES(?, ?)", 2, "a").execute();
+	}
+	catch (const SQLite3Error& e) {
+		thrown = true;
+		CHECK(e.code() == SQLITE_CONSTRAINT);
+		CHECK(e.extendedCode() == SQLITE_CONSTRAINT_UNIQUE);
+		CHECK(e.info().isConstraint() && !e.info().isBusy());
+		CHECK(e.sql() == "INSERT INTO T VALUES(?, ?)");
+	}
+	CHECK(thrown);
+
+	thrown = false;
+	try {
+		db.execute("SELECT * FROM T WHERE nope = 1");
+	}
+	catch (const SQLite3Error& e) {
+		thrown = true;
+		CHECK(e.code() == SQLITE_ERROR);
+		CHECK(std::string(e.what()).find("nope") != std::string::npos);
+#if SQLITE_VERSION_NUMBER >= 3038000
+		CHECK(e.offset() == 22);
+#endif
+	}
+	CHECK(thrown);
+
+	const SQLite3ErrorInfo busy = SQLite3ErrorInfo::fromCode(SQLITE_BUSY_SNAPSHOT, "busy");
+	CHECK(busy.code == SQLITE_BUSY && busy.extendedCode == SQLITE_BUSY_SNAPSHOT && busy.isBusy());
+}
+
+void testExpected()
+{
+	SQLite3 db(":memory:", table);
+	Expected<PreparedStatement> bad = db.tryPrepare("INSERT INTO Missing VALUES(?)");
+	CHECK(!bad && bad.error().code == SQLITE_ERROR);
+	bool thrown = false;
+	try {
+		bad.value();
+	}
+	catch (const SQLite3Error& e) {
+		thrown = e.sql() == "INSERT INTO Missing VALUES(?)";
+	}
+	CHECK(thrown);
+
+	Expected<PreparedStatement> insert = db.tryPrepare("INSERT INTO T VALUES(?, ?)");
+	CHECK(insert.ok());
+	CHECK(insert->tryBind(1, "a") == SQLITE_OK && insert->tryExecute() == SQLITE_OK);
+
+	Expected<ResultSet> rows = db.tryExecuteQuery("SELECT name FROM T");
+	CHECK(rows && rows->size() == 1 && (*rows)[0][0] == "a");
+	CHECK(db.tryExecuteQuery("SELECT nope FROM T").error().code == SQLITE_ERROR);
+
+	auto select = db.createPreparedStatement("SELECT id FROM T WHERE name = ?", "a");
+	Expected<ResultSet> selected = select.tryExecuteQuery();
+	CHECK(selected && selected.value().size() == 1 && selected->get<int>("id") == 1);
+
+	CHECK(db.tryExecute("DELETE FROM T").ok());
+	Expected<void> failed = db.tryExecute("DELETE FROM Missing");
+	CHECK(!failed && failed.error().message.find("Missing") != std::string::npos);
+}
+
+//Failed execution is reported by code and statement stays usable
+void testTryExecute()
+{
+	SQLite3 db(":memory:", table);
+	auto insert = db.createPreparedStatement("INSERT INTO T VALUES(?, ?)");
+	CHECK(insert.tryBind(1, "a") == SQLITE_OK && insert.tryExecute() == SQLITE_OK);
+	CHECK(insert.reset().tryBind(2, "a") == SQLITE_OK);
+	CHECK(insert.tryExecute() == SQLITE_CONSTRAINT);
+	CHECK(insert.lastError().extendedCode == SQLITE_CONSTRAINT_UNIQUE);
+	CHECK(insert.reset().tryBind(2, "b") == SQLITE_OK && insert.tryExecute() == SQLITE_OK);
+
+	CHECK(insert.reset().tryBind(3) == SQLITE_RANGE);
+	CHECK(insert.lastError().code == SQLITE_RANGE);
+	CHECK(db.executeQuery("SELECT count(*) n FROM T").get<int>("n") == 2);
+
+	const SQLite3Metrics metrics = db.metrics();
+	CHECK(metrics.errors[SQLITE_CONSTRAINT] == 1);
+}
+
+//Interrupted execution keeps kind of interruption in Expected
+void testExpectedInterruption()
+{
+	SQLite3 db(":memory:");
+	auto endless = db.createPreparedStatement("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c) SELECT x FROM c");
+	endless.timeout(std::chrono::milliseconds(20));
+	Expected<ResultSet> rows = endless.tryExecuteQuery();
+	CHECK(!rows && rows.error().code == SQLITE_INTERRUPT && rows.error().timedOut);
+	bool timedOut = false;
+	try {
+		rows.value();
+	}
+	catch (const QueryTimeout&) {
+		timedOut = true;
+	}
+	CHECK(timedOut);
+
+	CancellationToken token;
+	token.cancel();
+	endless.reset().timeout(std::chrono::milliseconds(0)).cancelWith(token);
+	rows = endless.tryExecuteQuery();
+	CHECK(!rows && rows.error().code == SQLITE_INTERRUPT && !rows.error().timedOut);
+	bool cancelled = false;
+	try {
+		rows.value();
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	CHECK(cancelled);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testErrorInfo);
+	RUN_TEST(testExpected);
+	RUN_TEST(testTryExecute);
+	RUN_TEST(testExpectedInterruption);
+	return testResult();
+}
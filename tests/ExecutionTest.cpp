@@ -0,0 +1,216 @@
+#include "MSQLite3Test.h"
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+using std::chrono::milliseconds;
+
+const char* const endless = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c) SELECT x FROM c";
+
+//Returns few rows far apart, first one immediately, whole query runs for seconds
+const char* const sparse = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<100000000) "
+	"SELECT x FROM c WHERE x%10000000 = 1";
+
+bool contains(const std::string& text, const std::string& part)
+{
+	return text.find(part) != std::string::npos;
+}
+
+void testTimeout()
+{
+	SQLite3 db(":memory:");
+	auto ps = db.createPreparedStatement(endless);
+	ps.timeout(milliseconds(30));
+	bool timedOut = false;
+	try {
+		ps.forEachRow([](sqlite3_stmt*) {});
+	}
+	catch (const QueryTimeout& e) {
+		timedOut = contains(e.what(), "30 ms");
+	}
+	CHECK(timedOut);
+	CHECK(ps.reset().tryExecute() == SQLITE_INTERRUPT);
+
+	db.setTimeout(milliseconds(30));
+	CHECK(db.tryExecute(endless).error().code == SQLITE_INTERRUPT);
+
+	//Statement without timeout runs to its end
+	db.setTimeout(milliseconds(0));
+	CHECK(db.executeQuery("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<100000) "
+		"SELECT count(*) n FROM c").get<int>("n") == 100000);
+	CHECK(db.metrics().timeouts == 3);
+}
+
+void testCancellation()
+{
+	SQLite3 db(":memory:");
+	CancellationToken token;
+	auto ps = db.createPreparedStatement(endless);
+	ps.cancelWith(token);
+	std::thread canceller([&token] {
+		std::this_thread::sleep_for(milliseconds(30));
+		token.cancel();
+	});
+	bool cancelled = false;
+	try {
+		ps.execute();
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	canceller.join();
+	CHECK(cancelled);
+
+	//Token cancelled before execution stops it before first step
+	CHECK(ps.reset().tryExecute() == SQLITE_INTERRUPT);
+	token.reset();
+	auto one = db.createPreparedStatement("SELECT 1");
+	one.cancelWith(token);
+	CHECK(one.tryExecute() == SQLITE_OK);
+	CHECK(db.metrics().cancellations == 2);
+}
+
+void testNestedKeepsOuterTimeout()
+{
+	SQLite3 db(":memory:");
+	auto outer = db.createPreparedStatement(sparse);
+	outer.timeout(milliseconds(100));
+	auto inner = db.createPreparedStatement("SELECT 1");
+	inner.timeout(milliseconds(10000));
+	auto unguarded = db.createPreparedStatement("SELECT 2");
+	int rows = 0;
+	bool timedOut = false;
+	try {
+		outer.forEachRow([&](sqlite3_stmt*) {
+			++rows;
+			CHECK(inner.reset().tryExecute() == SQLITE_OK);
+			CHECK(unguarded.reset().tryExecute() == SQLITE_OK);
+			db.execute("SELECT 3");
+		});
+	}
+	catch (const QueryTimeout& e) {
+		timedOut = contains(e.what(), "100 ms");
+	}
+	CHECK(timedOut);
+	CHECK(rows < 10);
+
+	//Guard of outer statement ended with it, following query is not limited by its deadline
+	std::this_thread::sleep_for(milliseconds(150));
+	CHECK(db.executeQuery("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<100000) "
+		"SELECT count(*) n FROM c").get<int>("n") == 100000);
+}
+
+void testNestedStoppedByOuter()
+{
+	SQLite3 db(":memory:");
+	auto outer = db.createPreparedStatement("SELECT 1");
+	outer.timeout(milliseconds(50));
+	auto inner = db.createPreparedStatement(endless);
+	int rc = SQLITE_OK;
+	std::string message;
+	outer.forEachRow([&](sqlite3_stmt*) {
+		rc = inner.tryExecute();
+		message = inner.lastError().message;
+	});
+	CHECK(rc == SQLITE_INTERRUPT);
+	CHECK(contains(message, "50 ms"));
+	CHECK(db.metrics().timeouts == 1);
+
+	CancellationToken token;
+	outer.reset().timeout(milliseconds(0)).cancelWith(token);
+	inner.reset().timeout(milliseconds(10000));
+	bool cancelled = false;
+	try {
+		outer.forEachRow([&](sqlite3_stmt*) {
+			token.cancel();
+			inner.execute();
+		});
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	CHECK(cancelled);
+}
+
+void testNestedCancellation()
+{
+	SQLite3 db(":memory:");
+	CancellationToken token;
+	auto outer = db.createPreparedStatement(sparse);
+	outer.cancelWith(token);
+	auto inner = db.createPreparedStatement("SELECT 1");
+	inner.timeout(milliseconds(10000));
+	int rows = 0;
+	bool cancelled = false;
+	try {
+		outer.forEachRow([&](sqlite3_stmt*) {
+			++rows;
+			inner.reset().execute();
+			token.cancel();
+		});
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	CHECK(cancelled);
+	CHECK(rows == 1);
+}
+
+int countCalls(void* data)
+{
+	++*static_cast<int*>(data);
+	return 0;
+}
+
+int stopExecution(void*)
+{
+	return 1;
+}
+
+void testProgressHandlerRestored()
+{
+	SQLite3 db(":memory:");
+	const char* const query = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<100000) SELECT count(*) FROM c";
+	int calls = 0;
+	db.setProgressHandler(100, countCalls, &calls);
+	auto ps = db.createPreparedStatement(query);
+	ps.timeout(milliseconds(10000));
+	ps.execute();
+	CHECK(calls > 0);
+
+	//Handler is restored after guarded execution and works for executions without timeout
+	const int guarded = calls;
+	db.execute(query);
+	CHECK(calls > guarded);
+
+	//Handler stops guarded execution as cancellation
+	db.setProgressHandler(100, stopExecution, nullptr);
+	bool cancelled = false;
+	try {
+		ps.reset().execute();
+	}
+	catch (const QueryCancelled&) {
+		cancelled = true;
+	}
+	CHECK(cancelled);
+	CHECK(db.tryExecute(query).error().code == SQLITE_INTERRUPT);
+
+	db.setProgressHandler(0, nullptr, nullptr);
+	CHECK(ps.reset().tryExecute() == SQLITE_OK);
+	CHECK(static_cast<bool>(db.tryExecute(query)));
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testTimeout);
+	RUN_TEST(testCancellation);
+	RUN_TEST(testNestedKeepsOuterTimeout);
+	RUN_TEST(testNestedStoppedByOuter);
+	RUN_TEST(testNestedCancellation);
+	RUN_TEST(testProgressHandlerRestored);
+	return testResult();
+}
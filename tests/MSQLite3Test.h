@@ -0,0 +1,89 @@
+#ifndef MSQLite3TestH
+#define MSQLite3TestH
+#include "MSQLite3.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+//Minimal harness of test programs, every program runs its tests and returns non zero when a check failed
+//Checks stay active in release builds, unlike assert
+//example
+/*
+	void testInsert()
+	{
+		SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER)");
+		CHECK(db.executeQuery("SELECT count(*) c FROM T").get<int>("c") == 0);
+	}
+
+	int main()
+	{
+		RUN_TEST(testInsert);
+		return testResult();
+	}
+*/
+
+inline int& testFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++testFailures(); \
+		} \
+	} while (0)
+
+//Runs test, exception escaping from it is reported as failure
+inline void runTest(const char* name, void (*test)())
+{
+	const int failures = testFailures();
+	try {
+		test();
+	}
+	catch (const std::exception& e) {
+		std::fprintf(stderr, "%s: unexpected exception: %s\n", name, e.what());
+		++testFailures();
+	}
+	std::printf("%s %s\n", failures == testFailures() ? "passed" : "FAILED", name);
+}
+
+#define RUN_TEST(test) runTest(#test, test)
+
+inline int testResult()
+{
+	return testFailures() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//Removes database file with its journal, WAL and shared memory files, on construction and destruction
+class TestDatabase
+{
+private:
+	std::string path;
+
+	void remove() const {
+		for (const char* suffix : { "", "-journal", "-wal", "-shm" })
+			std::remove((path + suffix).c_str());
+	}
+public:
+	explicit TestDatabase(const std::string& path)
+		:path(path)
+	{
+		remove();
+	}
+
+	~TestDatabase() {
+		remove();
+	}
+
+	TestDatabase(const TestDatabase&) = delete;
+	TestDatabase& operator=(const TestDatabase&) = delete;
+
+	const char* c_str() const {
+		return path.c_str();
+	}
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3Metrics.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace {
+
+//Metrics with distinct value in every rendered field
+SQLite3Metrics sampleMetrics()
+{
+	SQLite3Metrics metrics;
+	metrics.mainDb.reads = 1;
+	metrics.mainDb.writes = 2;
+	metrics.mainDb.syncs = 3;
+	metrics.mainDb.bytesRead = 4096;
+	metrics.mainDb.bytesWritten = 8192;
+	metrics.mainDb.readTime = std::chrono::microseconds(1500);
+	metrics.wal.writes = 5;
+	metrics.wal.bytesWritten = 20000;
+	metrics.wal.syncTime = std::chrono::milliseconds(2);
+	metrics.timeouts = 6;
+	metrics.cancellations = 7;
+	metrics.statements.executions = 100;
+	metrics.statements.rows = 250;
+	metrics.statements.vmSteps = 9000;
+	metrics.statements.fullScanSteps = 40;
+	metrics.statements.sorts = 3;
+	metrics.statements.autoIndexes = 1;
+	metrics.statements.time = std::chrono::milliseconds(125);
+	metrics.statements.timedExecutions = 50;
+	metrics.rawQueries = 8;
+	metrics.errors[SQLITE_BUSY] = 2;
+	metrics.errors[SQLITE_CONSTRAINT] = 4;
+	metrics.busy = 2;
+	metrics.transactionRetries = 1;
+	metrics.failedCommits = 0;
+	metrics.statementCacheHits = 90;
+	metrics.statementCacheMisses = 10;
+	metrics.pageCacheHits = 300;
+	metrics.pageCacheMisses = 100;
+	metrics.pageCacheWrites = 12;
+	metrics.pageCacheBytes = 65536;
+	metrics.walBytes = 4120;
+	return metrics;
+}
+
+const char* const expectedText =
+	"# TYPE msqlite3_queries counter\n"
+	"# HELP msqlite3_queries Executed queries, prepared statements and raw queries\n"
+	"msqlite3_queries_total{db=\"a\\\"b\\\\\",kind=\"prepared\"} 100\n"
+	"msqlite3_queries_total{db=\"a\\\"b\\\\\",kind=\"raw\"} 8\n"
+	"# TYPE msqlite3_rows counter\n"
+	"# HELP msqlite3_rows Rows returned by prepared statements\n"
+	"msqlite3_rows_total{db=\"a\\\"b\\\\\"} 250\n"
+	"# TYPE msqlite3_errors counter\n"
+	"# HELP msqlite3_errors Failed preparations and executions by primary result code\n"
+	"msqlite3_errors_total{db=\"a\\\"b\\\\\",code=\"SQLITE_BUSY\"} 2\n"
+	"msqlite3_errors_total{db=\"a\\\"b\\\\\",code=\"SQLITE_CONSTRAINT\"} 4\n"
+	"# TYPE msqlite3_busy counter\n"
+	"# HELP msqlite3_busy Executions which failed with SQLITE_BUSY or SQLITE_LOCKED\n"
+	"msqlite3_busy_total{db=\"a\\\"b\\\\\"} 2\n"
+	"# TYPE msqlite3_transaction_retries counter\n"
+	"# HELP msqlite3_transaction_retries Transactions run again after busy failure\n"
+	"msqlite3_transaction_retries_total{db=\"a\\\"b\\\\\"} 1\n"
+	"# TYPE msqlite3_failed_commits counter\n"
+	"# HELP msqlite3_failed_commits Transactions rolled back because commit in TransactionGuard failed\n"
+	"msqlite3_failed_commits_total{db=\"a\\\"b\\\\\"} 0\n"
+	"# TYPE msqlite3_timeouts counter\n"
+	"# HELP msqlite3_timeouts Executions stopped because their deadline passed\n"
+	"msqlite3_timeouts_total{db=\"a\\\"b\\\\\"} 6\n"
+	"# TYPE msqlite3_cancellations counter\n"
+	"# HELP msqlite3_cancellations Executions stopped by cancellation\n"
+	"msqlite3_cancellations_total{db=\"a\\\"b\\\\\"} 7\n"
+	"# TYPE msqlite3_execution_seconds summary\n"
+	"# HELP msqlite3_execution_seconds Time of prepared statement executions run with timing\n"
+	"msqlite3_execution_seconds_sum{db=\"a\\\"b\\\\\"} 0.125\n"
+	"msqlite3_execution_seconds_count{db=\"a\\\"b\\\\\"} 50\n"
+	"# TYPE msqlite3_vm_steps counter\n"
+	"# HELP msqlite3_vm_steps Virtual machine operations of prepared statements\n"
+	"msqlite3_vm_steps_total{db=\"a\\\"b\\\\\"} 9000\n"
+	"# TYPE msqlite3_full_scan_steps counter\n"
+	"# HELP msqlite3_full_scan_steps Steps of full table scans\n"
+	"msqlite3_full_scan_steps_total{db=\"a\\\"b\\\\\"} 40\n"
+	"# TYPE msqlite3_sorts counter\n"
+	"# HELP msqlite3_sorts Sorts done by prepared statements\n"
+	"msqlite3_sorts_total{db=\"a\\\"b\\\\\"} 3\n"
+	"# TYPE msqlite3_auto_indexes counter\n"
+	"# HELP msqlite3_auto_indexes Automatic indexes built by prepared statements\n"
+	"msqlite3_auto_indexes_total{db=\"a\\\"b\\\\\"} 1\n"
+	"# TYPE msqlite3_statement_cache_requests counter\n"
+	"# HELP msqlite3_statement_cache_requests Requests of cached statements\n"
+	"msqlite3_statement_cache_requests_total{db=\"a\\\"b\\\\\",result=\"hit\"} 90\n"
+	"msqlite3_statement_cache_requests_total{db=\"a\\\"b\\\\\",result=\"miss\"} 10\n"
+	"# TYPE msqlite3_page_cache_requests counter\n"
+	"# HELP msqlite3_page_cache_requests Page requests served by page cache of connection and read from file\n"
+	"msqlite3_page_cache_requests_total{db=\"a\\\"b\\\\\",result=\"hit\"} 300\n"
+	"msqlite3_page_cache_requests_total{db=\"a\\\"b\\\\\",result=\"miss\"} 100\n"
+	"# TYPE msqlite3_page_cache_hit_ratio gauge\n"
+	"# HELP msqlite3_page_cache_hit_ratio Share of page requests served by page cache\n"
+	"msqlite3_page_cache_hit_ratio{db=\"a\\\"b\\\\\"} 0.75\n"
+	"# TYPE msqlite3_page_cache_writes counter\n"
+	"# HELP msqlite3_page_cache_writes Pages written from page cache\n"
+	"msqlite3_page_cache_writes_total{db=\"a\\\"b\\\\\"} 12\n"
+	"# TYPE msqlite3_page_cache_bytes gauge\n"
+	"# HELP msqlite3_page_cache_bytes Memory used by page cache\n"
+	"msqlite3_page_cache_bytes{db=\"a\\\"b\\\\\"} 65536\n"
+	"# TYPE msqlite3_wal_bytes gauge\n"
+	"# HELP msqlite3_wal_bytes Size of write-ahead log of main database\n"
+	"msqlite3_wal_bytes{db=\"a\\\"b\\\\\"} 4120\n"
+	"# TYPE msqlite3_io_operations counter\n"
+	"# HELP msqlite3_io_operations File operations counted by InstrumentedVfs, zero unless it is installed\n"
+	"msqlite3_io_operations_total{file=\"main\",op=\"read\"} 1\n"
+	"msqlite3_io_operations_total{file=\"main\",op=\"write\"} 2\n"
+	"msqlite3_io_operations_total{file=\"main\",op=\"sync\"} 3\n"
+	"msqlite3_io_operations_total{file=\"wal\",op=\"read\"} 0\n"
+	"msqlite3_io_operations_total{file=\"wal\",op=\"write\"} 5\n"
+	"msqlite3_io_operations_total{file=\"wal\",op=\"sync\"} 0\n"
+	"msqlite3_io_operations_total{file=\"journal\",op=\"read\"} 0\n"
+	"msqlite3_io_operations_total{file=\"journal\",op=\"write\"} 0\n"
+	"msqlite3_io_operations_total{file=\"journal\",op=\"sync\"} 0\n"
+	"msqlite3_io_operations_total{file=\"other\",op=\"read\"} 0\n"
+	"msqlite3_io_operations_total{file=\"other\",op=\"write\"} 0\n"
+	"msqlite3_io_operations_total{file=\"other\",op=\"sync\"} 0\n"
+	"# TYPE msqlite3_io_bytes counter\n"
+	"# HELP msqlite3_io_bytes Bytes read and written through InstrumentedVfs\n"
+	"msqlite3_io_bytes_total{file=\"main\",op=\"read\"} 4096\n"
+	"msqlite3_io_bytes_total{file=\"main\",op=\"write\"} 8192\n"
+	"msqlite3_io_bytes_total{file=\"wal\",op=\"read\"} 0\n"
+	"msqlite3_io_bytes_total{file=\"wal\",op=\"write\"} 20000\n"
+	"msqlite3_io_bytes_total{file=\"journal\",op=\"read\"} 0\n"
+	"msqlite3_io_bytes_total{file=\"journal\",op=\"write\"} 0\n"
+	"msqlite3_io_bytes_total{file=\"other\",op=\"read\"} 0\n"
+	"msqlite3_io_bytes_total{file=\"other\",op=\"write\"} 0\n"
+	"# TYPE msqlite3_io_seconds counter\n"
+	"# HELP msqlite3_io_seconds Time spent in file operations through InstrumentedVfs\n"
+	"msqlite3_io_seconds_total{file=\"main\",op=\"read\"} 0.0015\n"
+	"msqlite3_io_seconds_total{file=\"main\",op=\"write\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"main\",op=\"sync\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"wal\",op=\"read\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"wal\",op=\"write\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"wal\",op=\"sync\"} 0.002\n"
+	"msqlite3_io_seconds_total{file=\"journal\",op=\"read\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"journal\",op=\"write\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"journal\",op=\"sync\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"other\",op=\"read\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"other\",op=\"write\"} 0\n"
+	"msqlite3_io_seconds_total{file=\"other\",op=\"sync\"} 0\n"
+	"# EOF\n";
+
+void testRenderText()
+{
+	std::string text;
+	MetricsRegistry::render(text, { { "a\"b\\", sampleMetrics() } });
+	CHECK(text == expectedText);
+	if (text != expectedText)
+		std::fprintf(stderr, "%s", text.c_str());
+}
+
+void testRegistry()
+{
+	MetricsRegistry registry;
+	CHECK(registry.render().find("msqlite3_rows_total") == std::string::npos);
+
+	SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER)");
+	db.createPreparedStatement("INSERT INTO T VALUES(?)", 1).execute();
+	registry.add("live", db);
+	registry.update("copy", sampleMetrics());
+	const std::string text = registry.render();
+	//Samples of family are sorted by name of connection
+	const size_t copy = text.find("msqlite3_rows_total{db=\"copy\"} 250\n");
+	const size_t live = text.find("msqlite3_rows_total{db=\"live\"} 0\n");
+	CHECK(copy != std::string::npos && live != std::string::npos && copy < live);
+	CHECK(text.find("msqlite3_queries_total{db=\"live\",kind=\"prepared\"} 1\n") != std::string::npos);
+
+	registry.remove("copy");
+	CHECK(registry.render().find("db=\"copy\"") == std::string::npos);
+}
+
+void testPageCacheNotReset()
+{
+	TestDatabase file("metrics.db");
+	SQLite3 db("metrics.db", "CREATE TABLE T(a INTEGER, b TEXT)");
+	db.execute("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<20000) "
+		"INSERT INTO T SELECT x, hex(randomblob(20)) FROM c");
+	db.executeQuery("SELECT count(*) FROM T WHERE b > 'A'");
+	const SQLite3Metrics first = db.metrics();
+	CHECK(first.pageCacheHits > 0 && first.pageCacheWrites > 0);
+
+	//Application still sees whole counters of SQLite
+	int current = 0, highwater = 0;
+	sqlite3_db_status(db.handle(), SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 0);
+	CHECK(static_cast<uint64_t>(current) == first.pageCacheHits);
+
+	db.executeQuery("SELECT count(*) FROM T WHERE b > 'A'");
+	const SQLite3Metrics second = db.metrics();
+	CHECK(second.pageCacheHits > first.pageCacheHits);
+	CHECK(db.metrics().pageCacheHits == second.pageCacheHits);
+}
+
+//Registry renders connection while other thread uses it, serialized SQLite locks connection for metrics
+void testRenderDuringQueries()
+{
+	if (sqlite3_threadsafe() != 1)
+		return;
+	TestDatabase file("metrics.db");
+	SQLite3 db("metrics.db", "CREATE TABLE T(a INTEGER)");
+	db.execute("PRAGMA journal_mode=WAL");
+	MetricsRegistry registry;
+	registry.add("db", db);
+	std::atomic<bool> done{ false };
+	std::thread writer([&] {
+		auto insert = db.createPreparedStatement("INSERT INTO T VALUES(?)");
+		for (int i = 0; i < 500; ++i)
+			insert.reset().bind(i).execute();
+		done = true;
+	});
+	size_t renders = 0;
+	while (!done || renders == 0) {
+		CHECK(registry.render().find("# EOF\n") != std::string::npos);
+		++renders;
+	}
+	writer.join();
+	CHECK(registry.render().find("msqlite3_queries_total{db=\"db\",kind=\"prepared\"} 500\n") != std::string::npos);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testRenderText);
+	RUN_TEST(testRegistry);
+	RUN_TEST(testPageCacheNotReset);
+	RUN_TEST(testRenderDuringQueries);
+	return testResult();
+}
@@ -0,0 +1,93 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3Pipeline.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void fill(SQLite3& db, int rows)
+{
+	db.execute(("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<" + std::to_string(rows) + ") "
+		"INSERT INTO T SELECT x, 'n'||x FROM c").c_str());
+}
+
+void testAllRowsProcessed()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT)");
+	fill(db, 50000);
+	for (unsigned consumers : { 1u, 3u })
+		for (size_t batchSize : { 1, 100, 4096 }) {
+			auto ps = db.createPreparedStatement("SELECT * FROM T");
+			std::atomic<long> sum{ 0 }, rows{ 0 }, names{ 0 };
+			PipelineOptions options;
+			options.consumers = consumers;
+			options.batchSize = batchSize;
+			options.depth = 2;
+			executePipelined(ps, [&](const ResultRow& row) {
+				const long id = row.get<long>("id");
+				sum += id;
+				++rows;
+				if (row.get<std::string>("name") == "n" + std::to_string(id))
+					++names;
+			}, options);
+			CHECK(rows == 50000);
+			CHECK(names == 50000);
+			CHECK(sum == 50000L * 50001 / 2);
+		}
+}
+
+void testEmptyResult()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT)");
+	auto ps = db.createPreparedStatement("SELECT * FROM T");
+	std::atomic<int> rows{ 0 };
+	executePipelined(ps, [&](const ResultRow&) { ++rows; });
+	CHECK(rows == 0);
+}
+
+void testConsumerException()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT)");
+	fill(db, 20000);
+	auto ps = db.createPreparedStatement("SELECT * FROM T");
+	PipelineOptions options;
+	options.consumers = 2;
+	std::string message;
+	try {
+		executePipelined(ps, [](const ResultRow& row) {
+			if (row.get<long>("id") == 5000)
+				throw std::runtime_error("consumer failed");
+		}, options);
+	}
+	catch (const std::runtime_error& e) {
+		message = e.what();
+	}
+	CHECK(message == "consumer failed");
+}
+
+void testStatementError()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(id INTEGER, name TEXT)");
+	fill(db, 1000);
+	auto ps = db.createPreparedStatement("SELECT abs(-9223372036854775807-1) FROM T");
+	bool thrown = false;
+	try {
+		executePipelined(ps, [](const ResultRow&) {});
+	}
+	catch (const SQLite3Error&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testAllRowsProcessed);
+	RUN_TEST(testEmptyResult);
+	RUN_TEST(testConsumerException);
+	RUN_TEST(testStatementError);
+	return testResult();
+}
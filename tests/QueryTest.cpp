@@ -0,0 +1,39 @@
+#include "MSQLite3Test.h"
+#include <string>
+
+namespace {
+
+//Counting runs at compile time, wrong count fails build
+static_assert(countPlaceholders("SELECT 1") == 0, "no placeholders");
+static_assert(countPlaceholders("INSERT INTO T VALUES(?, ?, ?)") == 3, "positional placeholders");
+static_assert(countPlaceholders("SELECT '?', \"?\", `?`, [?] FROM T WHERE a = ?") == 1, "quoted placeholders are skipped");
+static_assert(countPlaceholders("SELECT 'it''s ?' WHERE a = ?") == 1, "escaped quote keeps literal open");
+static_assert(countPlaceholders("SELECT ? -- ?\n, ? /* ? */") == 2, "comments are skipped");
+static_assert(countPlaceholders("SELECT ?1, ?2") == -1, "numbered parameters can not be counted");
+static_assert(countPlaceholders("SELECT :a, @b, $c") == -1, "named parameters can not be counted");
+static_assert(countPlaceholders("SELECT 'unterminated ?") == 0, "unterminated literal");
+static_assert(decltype(MSQLITE3_QUERY("SELECT ? + ?"))::paramCount == 2, "count is part of type");
+
+void testStaticStatement()
+{
+	SQLite3 db(":memory:", "CREATE TABLE User(id INTEGER PRIMARY KEY, name TEXT)");
+	auto insert = db.createPreparedStatement(MSQLITE3_TYPED_QUERY("INSERT INTO User(id, name) VALUES(?, ?)", int, std::string));
+	insert.bind(1, "Alice").execute();
+	insert.reset().bind(2, std::string("Bob")).execute();
+	CHECK(insert.reset().tryBind(3, "Carol") == SQLITE_OK);
+	CHECK(insert.tryExecute() == SQLITE_OK);
+
+	auto count = db.createPreparedStatement(MSQLITE3_QUERY("SELECT count(*) c FROM User WHERE id > ? AND name <> '?'"), 1);
+	CHECK(count.executeQuery().get<int>("c") == 2);
+
+	auto all = db.createPreparedStatement(MSQLITE3_QUERY("SELECT name FROM User ORDER BY id"));
+	CHECK(all.executeQuery().size() == 3);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testStaticStatement);
+	return testResult();
+}
@@ -0,0 +1,153 @@
+#include "MSQLite3Test.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const char* const table = "CREATE TABLE User(id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL COLLATE NOCASE, score REAL)";
+
+void fill(SQLite3& db, int rows)
+{
+	db.execute(("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<" + std::to_string(rows) + ") "
+		"INSERT INTO User(name, score) SELECT 'u'||x, (x*7)%100 FROM c").c_str());
+}
+
+void testIteration()
+{
+	SQLite3 db(":memory:", table);
+	fill(db, 100);
+	ResultSet rs = db.executeQuery("SELECT id, name, score FROM User");
+	CHECK(rs.size() == 100);
+	CHECK(std::distance(rs.begin(), rs.end()) == 100);
+
+	//Rows are sorted in place by random access iterators
+	std::sort(rs.begin(), rs.end(), [](const ResultRow& a, const ResultRow& b) {
+		return a.get<double>("score") < b.get<double>("score") || (a.get<double>("score") == b.get<double>("score") && a.get<int>("id") < b.get<int>("id"));
+	});
+	CHECK(std::is_sorted(rs.begin(), rs.end(), [](const ResultRow& a, const ResultRow& b) {
+		return a.get<double>("score") < b.get<double>("score");
+	}));
+	auto found = std::lower_bound(rs.begin(), rs.end(), 50.0, [](const ResultRow& row, double score) {
+		return row.get<double>("score") < score;
+	});
+	CHECK(found != rs.end() && found->get<double>("score") == 50);
+
+	//Reverse iteration and cursor work on the same rows
+	const ResultSet& constRows = rs;
+	CHECK(std::prev(constRows.end())->get<double>("score") == 99);
+	CHECK(rs.seek(99) && rs.position() == 99 && rs.get<double>("score") == 99);
+	CHECK(!rs.next() && !rs.seek(100));
+	CHECK(rs.seek(0) && rs.get<double>("score") == 0);
+
+	int sum = 0;
+	for (const ResultRow& row : constRows)
+		sum += row.get<int>("id");
+	CHECK(sum == 100 * 101 / 2);
+}
+
+void testParallel()
+{
+	SQLite3 db(":memory:", table);
+	fill(db, 10000);
+	const ResultSet rs = db.executeQuery("SELECT id, score FROM User ORDER BY id");
+
+	std::atomic<long> ids{ 0 };
+	rs.parallelForEach([&ids](const ResultRow& row) {
+		ids += row.get<long>("id");
+	}, 4);
+	CHECK(ids == 10000L * 10001 / 2);
+
+	//Results keep order of rows for every count of threads
+	for (unsigned threads : { 0u, 1u, 3u, 8u }) {
+		const std::vector<int> doubled = rs.transform([](const ResultRow& row) { return row.get<int>("id") * 2; }, threads);
+		CHECK(doubled.size() == 10000);
+		bool ordered = true;
+		for (size_t i = 0; i < doubled.size(); ++i)
+			ordered = ordered && doubled[i] == static_cast<int>(i + 1) * 2;
+		CHECK(ordered);
+	}
+
+	//Exception thrown by one range is rethrown after all ranges finished
+	bool thrown = false;
+	try {
+		rs.parallelForEach([](const ResultRow& row) {
+			if (row.get<int>("id") == 9000)
+				throw std::runtime_error("row 9000");
+		}, 4);
+	}
+	catch (const std::runtime_error& e) {
+		thrown = std::string(e.what()) == "row 9000";
+	}
+	CHECK(thrown);
+
+	const ResultSet empty = db.executeQuery("SELECT id FROM User WHERE id < 0");
+	CHECK(empty.transform([](const ResultRow& row) { return row[0]; }).empty());
+}
+
+//Rows of one result share one schema, so column names are stored once
+void testSharedSchema()
+{
+	SQLite3 db(":memory:", table);
+	fill(db, 10);
+	ResultSet raw = db.executeQuery("SELECT id, name FROM User");
+	CHECK(&raw[0].columns() == &raw[9].columns());
+	CHECK(raw.columns().size() == 2 && raw.columns()[1].name == "name");
+	CHECK(raw[3].has("name") && !raw[3].has("score"));
+	CHECK(raw[3].get<std::string>("name") == "u4");
+
+	auto ps = db.createPreparedStatement("SELECT id, score FROM User WHERE id > ?", 5);
+	ResultSet prepared = ps.executeQuery();
+	CHECK(prepared.size() == 5 && &prepared[0].columns() == &prepared[4].columns());
+	CHECK(prepared.columns().find("score") == 1 && prepared.columns().find("name") == -1);
+
+	bool thrown = false;
+	try {
+		prepared[0].get<int>("name");
+	}
+	catch (const ColumnNotFound&) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	//Merged results keep schema of rows they came from
+	ResultSet merged = db.executeQuery("SELECT id, name FROM User WHERE id <= 2");
+	merged.merge(db.executeQuery("SELECT id, name FROM User WHERE id > 8"));
+	CHECK(merged.size() == 4 && merged[3].get<int>("id") == 10 && merged.columns().size() == 2);
+}
+
+void testColumnMetadata()
+{
+	SQLite3 db(":memory:", table);
+	auto ps = db.createPreparedStatement("SELECT u.id, u.name AS userName, score * 2 AS doubled FROM User u");
+	const ResultSchema& columns = ps.columns();
+	CHECK(columns.size() == 3);
+	CHECK(columns[0].name == "id" && columns[0].declaredType == "INTEGER");
+	CHECK(columns[1].name == "userName" && columns[1].declaredType == "TEXT");
+	CHECK(columns[2].name == "doubled" && columns[2].declaredType.empty() && !columns[2].hasOrigin());
+	CHECK(columns.find("userName") == 1);
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+	CHECK(columns[0].hasOrigin() && columns[0].table == "User" && columns[0].origin == "id" && columns[0].database == "main");
+	CHECK(columns[0].primaryKey && columns[0].autoIncrement);
+	CHECK(columns[1].origin == "name" && columns[1].notNull && !columns[1].primaryKey);
+	CHECK(columns[1].collation == "NOCASE");
+#endif
+
+	//Result of statement is described by the same columns
+	db.execute("INSERT INTO User(name, score) VALUES('a', 1.5)");
+	ResultSet rs = ps.executeQuery();
+	CHECK(rs.columns().size() == 3 && rs.columns()[1].name == "userName");
+	CHECK(rs.get<double>("doubled") == 3);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testIteration);
+	RUN_TEST(testParallel);
+	RUN_TEST(testSharedSchema);
+	RUN_TEST(testColumnMetadata);
+	return testResult();
+}
@@ -0,0 +1,80 @@
+#include "MSQLite3Test.h"
+#include "MShardedDatabase.h"
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+//Values are part of file format of shards, they must never change
+void testKeyHashIsFixed()
+{
+	CHECK(shardKeyHash("") == 14695981039346656037ull);
+	CHECK(shardKeyHash("a") == 0xaf63dc4c8601ec8cull);
+	CHECK(shardKeyHash(std::string("a")) == shardKeyHash("a"));
+	CHECK(shardKeyHash(5) == 1000385178204227360ull);
+	CHECK(shardKeyHash(static_cast<int64_t>(5)) == shardKeyHash(static_cast<short>(5)));
+
+	TestDatabase s0("sharded_test_0.db"), s1("sharded_test_1.db"), s2("sharded_test_2.db");
+	ShardedDatabase db({ s0.c_str(), s1.c_str(), s2.c_str() });
+	CHECK(db.shardFor(5) == 2);
+	char key[] = "a";
+	CHECK(db.shardFor(key) == db.shardFor(std::string("a")));
+}
+
+int rows(ShardedDatabase& db)
+{
+	return db.query(0, "SELECT count(*) c FROM T").get<int>("c");
+}
+
+std::string error(std::future<void>& done)
+{
+	try {
+		done.get();
+	}
+	catch (const SQLite3Error& e) {
+		return e.what();
+	}
+	return "";
+}
+
+//Tasks behind statement which rolled back grouped transaction must not run in autocommit mode
+void testRolledBackBatch()
+{
+	TestDatabase file("sharded_test_0.db");
+	ShardedDatabase db({ file.c_str() }, "CREATE TABLE IF NOT EXISTS T(a INTEGER)");
+
+	//Keeps shard thread busy, so following tasks are queued into one batch
+	std::promise<void> started;
+	auto busy = db.submit(0, [&started](SQLite3&) {
+		started.set_value();
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	});
+	started.get_future().wait();
+	auto first = db.execute(0, "INSERT INTO T VALUES(?)", 1);
+	auto failing = db.submit(0, [](SQLite3& shard) {
+		shard.execute("ROLLBACK");
+		throw SQLite3Error("statement failed");
+	});
+	auto skipped = db.execute(0, "INSERT INTO T VALUES(?)", 2);
+	busy.get();
+
+	const std::string firstError = error(first);
+	CHECK(firstError.find("rolled back by failed statement") != std::string::npos);
+	CHECK(error(failing) == "statement failed");
+	const std::string skippedError = error(skipped);
+	CHECK(skippedError.find("not executed") != std::string::npos);
+	CHECK(rows(db) == 0);
+
+	db.execute(0, "INSERT INTO T VALUES(?)", 3).get();
+	CHECK(rows(db) == 1);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testKeyHashIsFixed);
+	RUN_TEST(testRolledBackBatch);
+	return testResult();
+}
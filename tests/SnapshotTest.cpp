@@ -0,0 +1,92 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3Snapshot.h"
+#include <cstdio>
+
+//Snapshots need SQLite built with SQLITE_ENABLE_SNAPSHOT, without it test reports itself skipped
+#ifdef SQLITE_ENABLE_SNAPSHOT
+
+namespace {
+
+const char* const path = "snapshot_test.db";
+
+long count(SQLite3& db)
+{
+	return db.executeQuery("SELECT count(*) c FROM T").get<long>("c");
+}
+
+void testConsistentReads()
+{
+	TestDatabase file(path);
+	SQLite3 writer(path, "CREATE TABLE T(a INTEGER)");
+	writer.execute("PRAGMA journal_mode=WAL");
+	writer.execute("INSERT INTO T VALUES(1)");
+
+	//Keeper holds read transaction, so WAL is not checkpointed past snapshot
+	SQLite3 keeper(path);
+	keeper.beginTransaction();
+	CHECK(count(keeper) == 1);
+	const Snapshot first = Snapshot::capture(keeper);
+
+	writer.execute("INSERT INTO T VALUES(2)");
+	const Snapshot second = Snapshot::capture(writer);
+	CHECK(first < second && !(second < first) && first == first);
+
+	SQLite3 reader(path);
+	CHECK(count(reader) == 2);
+	{
+		SnapshotTransaction st(reader, first);
+		CHECK(count(reader) == 1);
+		writer.execute("INSERT INTO T VALUES(3)");
+		CHECK(count(reader) == 1);
+	}
+	CHECK(!reader.inTransaction() && count(reader) == 3);
+	{
+		SnapshotTransaction st(reader, second);
+		CHECK(count(reader) == 2);
+	}
+	keeper.endTransaction();
+}
+
+//Snapshot can not be opened after WAL was checkpointed past it
+void testExpiredSnapshot()
+{
+	TestDatabase file(path);
+	SQLite3 writer(path, "CREATE TABLE T(a INTEGER)");
+	writer.execute("PRAGMA journal_mode=WAL");
+	writer.execute("INSERT INTO T VALUES(1)");
+	const Snapshot old = Snapshot::capture(writer);
+	writer.execute("INSERT INTO T VALUES(2)");
+	writer.execute("PRAGMA wal_checkpoint(TRUNCATE)");
+	writer.execute("INSERT INTO T VALUES(3)");
+
+	SQLite3 reader(path);
+	int code = SQLITE_OK, extendedCode = SQLITE_OK;
+	try {
+		SnapshotTransaction st(reader, old);
+	}
+	catch (const SQLite3Error& e) {
+		code = e.code();
+		extendedCode = e.extendedCode();
+	}
+	CHECK(code == SQLITE_ERROR && extendedCode == SQLITE_ERROR_SNAPSHOT);
+	CHECK(!reader.inTransaction() && count(reader) == 3);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testConsistentReads);
+	RUN_TEST(testExpiredSnapshot);
+	return testResult();
+}
+
+#else
+
+int main()
+{
+	std::printf("skipped, SQLite is built without SQLITE_ENABLE_SNAPSHOT\n");
+	return 77;
+}
+
+#endif
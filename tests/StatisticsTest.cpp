@@ -0,0 +1,90 @@
+#include "MSQLite3Test.h"
+#include <string>
+
+namespace {
+
+void fill(SQLite3& db, const char* table, int rows)
+{
+	db.execute((std::string("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x<") + std::to_string(rows) + ") "
+		"INSERT INTO " + table + " SELECT x, x%50 FROM c").c_str());
+}
+
+void testCounters()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER PRIMARY KEY, b INTEGER)");
+	fill(db, "T", 1000);
+
+	auto byKey = db.createPreparedStatement("SELECT b FROM T WHERE a = ?");
+	for (int key = 1; key <= 10; ++key)
+		byKey.reset().bind(key).executeQuery();
+	CHECK(byKey.stats().executions == 10 && byKey.stats().rows == 10);
+	CHECK(byKey.stats().fullScanSteps == 0 && byKey.stats().sorts == 0);
+	CHECK(byKey.stats().vmSteps > 0 && byKey.stats().failures == 0);
+
+	auto scan = db.createPreparedStatement("SELECT a FROM T WHERE b = ? ORDER BY a % 7", 7);
+	CHECK(scan.executeQuery().size() == 20);
+	CHECK(scan.stats().fullScanSteps >= 999);
+	CHECK(scan.stats().sorts == 1 && scan.stats().rows == 20);
+
+	db.execute("CREATE TABLE U(a INTEGER, b INTEGER)");
+	fill(db, "U", 1000);
+	auto join = db.createPreparedStatement("SELECT count(*) FROM T JOIN U ON T.b = U.a");
+	join.execute();
+	//Counter of SQLite is count of rows inserted into automatic indexes
+	CHECK(join.stats().autoIndexes > 0);
+
+	//Connection sums statistics of all its statements
+	const StatementStats total = db.metrics().statements;
+	CHECK(total.executions == byKey.stats().executions + scan.stats().executions + join.stats().executions);
+	CHECK(total.rows == byKey.stats().rows + scan.stats().rows + join.stats().rows);
+	CHECK(total.vmSteps == byKey.stats().vmSteps + scan.stats().vmSteps + join.stats().vmSteps);
+}
+
+void testFailuresAndReprepare()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER PRIMARY KEY)");
+	auto insert = db.createPreparedStatement("INSERT INTO T VALUES(?)", 1);
+	insert.execute();
+	CHECK(insert.reset().bind(1).tryExecute() == SQLITE_CONSTRAINT);
+	CHECK(insert.stats().executions == 2 && insert.stats().failures == 1);
+	CHECK(db.metrics().statements.failures == 1);
+
+	//Statement is recompiled after schema changed
+	auto select = db.createPreparedStatement("SELECT a FROM T");
+	select.executeQuery();
+	db.execute("CREATE INDEX TA ON T(a)");
+	select.reset().executeQuery();
+	CHECK(select.stats().reprepares == 1);
+}
+
+void testTiming()
+{
+	SQLite3 db(":memory:", "CREATE TABLE T(a INTEGER, b INTEGER)");
+	fill(db, "T", 10000);
+	auto untimed = db.createPreparedStatement("SELECT sum(b) FROM T");
+	untimed.execute();
+	CHECK(untimed.stats().timedExecutions == 0 && untimed.stats().time.count() == 0);
+	CHECK(untimed.stats().averageTime().count() == 0);
+
+	untimed.timing(true);
+	untimed.reset().execute();
+	CHECK(untimed.stats().timedExecutions == 1 && untimed.stats().time.count() > 0);
+
+	db.setTiming(true);
+	auto timed = db.createPreparedStatement("SELECT sum(b) FROM T");
+	timed.execute();
+	timed.reset().execute();
+	CHECK(timed.stats().timedExecutions == 2 && timed.stats().executions == 2);
+	CHECK(timed.stats().averageTime() == timed.stats().time / 2);
+	CHECK(db.metrics().statements.timedExecutions == 3);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testCounters);
+	RUN_TEST(testFailuresAndReprepare);
+	RUN_TEST(testTiming);
+	return testResult();
+}
@@ -0,0 +1,135 @@
+#include "MSQLite3Test.h"
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const char* const path = "transaction_test.db";
+const char* const table = "CREATE TABLE T(a INTEGER)";
+
+long count(SQLite3& db)
+{
+	return db.executeQuery("SELECT count(*) c FROM T").get<long>("c");
+}
+
+//Other connection holds write lock for [hold], transaction waits for it by retries
+void testRetryOnBusy()
+{
+	TestDatabase file(path);
+	SQLite3 db(path, table);
+	SQLite3 other(path);
+
+	other.beginWriteTransaction();
+	std::thread holder([&] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		other.endTransaction();
+	});
+
+	int runs = 0;
+	db.transaction([&] {
+		++runs;
+		db.execute("INSERT INTO T VALUES(1)");
+	}, 100);
+	holder.join();
+	CHECK(runs == 1);
+	CHECK(count(db) == 1);
+	const SQLite3Metrics metrics = db.metrics();
+	CHECK(metrics.transactionRetries > 0);
+	CHECK(metrics.errors[SQLITE_BUSY] == metrics.transactionRetries);
+}
+
+void testAttemptsExhausted()
+{
+	TestDatabase file(path);
+	SQLite3 db(path, table);
+	SQLite3 other(path);
+	other.beginWriteTransaction();
+
+	int code = SQLITE_OK;
+	const auto start = std::chrono::steady_clock::now();
+	try {
+		db.transaction([&] {
+			db.execute("INSERT INTO T VALUES(1)");
+		}, 4);
+	}
+	catch (const SQLite3Error& e) {
+		code = e.code();
+	}
+	//Backoff of 3 retries waits at least 0.5 + 1 + 2 ms
+	CHECK(std::chrono::steady_clock::now() - start >= std::chrono::microseconds(3500));
+	CHECK(code == SQLITE_BUSY);
+	CHECK(db.metrics().transactionRetries == 3);
+	CHECK(!db.inTransaction());
+	other.endTransaction();
+	CHECK(count(db) == 0);
+}
+
+//Exception of body rolls transaction back and is not retried
+void testBodyFailure()
+{
+	SQLite3 db(":memory:", table);
+	int runs = 0;
+	bool thrown = false;
+	try {
+		db.transaction([&] {
+			++runs;
+			db.execute("INSERT INTO T VALUES(1)");
+			throw std::runtime_error("body");
+		});
+	}
+	catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	CHECK(thrown && runs == 1);
+	CHECK(!db.inTransaction() && count(db) == 0);
+
+	//Constraint violation is not busy failure, it is not retried either
+	runs = 0;
+	thrown = false;
+	try {
+		db.transaction([&] {
+			++runs;
+			db.execute("INSERT INTO Missing VALUES(1)");
+		});
+	}
+	catch (const SQLite3Error& e) {
+		thrown = e.code() == SQLITE_ERROR;
+	}
+	CHECK(thrown && runs == 1 && db.metrics().transactionRetries == 0);
+}
+
+//Commit in destructor of TransactionGuard fails while reader holds shared lock in rollback journal mode
+void testGuardFailedCommit()
+{
+	TestDatabase file(path);
+	SQLite3 db(path, table);
+	SQLite3 reader(path);
+	reader.beginTransaction();
+	CHECK(count(reader) == 0);
+	{
+		TransactionGuard tg(&db, true);
+		db.execute("INSERT INTO T VALUES(1)");
+	}
+	CHECK(db.metrics().failedCommits == 1);
+	CHECK(!db.inTransaction());
+	reader.endTransaction();
+	CHECK(count(db) == 0);
+
+	{
+		TransactionGuard tg(&db, true);
+		db.execute("INSERT INTO T VALUES(1)");
+	}
+	CHECK(count(reader) == 1 && db.metrics().failedCommits == 1);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testRetryOnBusy);
+	RUN_TEST(testAttemptsExhausted);
+	RUN_TEST(testBodyFailure);
+	RUN_TEST(testGuardFailedCommit);
+	return testResult();
+}
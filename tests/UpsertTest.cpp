@@ -0,0 +1,135 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3BulkInsert.h"
+#include "MSQLite3Upsert.h"
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+typedef std::tuple<int, std::string, double> User;
+
+void testUpsert()
+{
+	SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER PRIMARY KEY, name TEXT, score REAL)");
+	Upsert<int, std::string, double> upsert(db, "U", { "id", "name", "score" }, { "id" });
+	CHECK(upsert(1, "a", 1.0) == UpsertResult::Inserted);
+	CHECK(upsert(1, "b", 1.0) == UpsertResult::Updated);
+	CHECK(upsert(1, "b", 1.0) == UpsertResult::Unchanged);
+	CHECK(db.executeQuery("SELECT name FROM U WHERE id = 1").get<std::string>("name") == "b");
+}
+
+void testMerge()
+{
+	SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER PRIMARY KEY, name TEXT, score REAL)");
+	Upsert<int, std::string, double> upsert(db, "U", { "id", "name", "score" }, { "id" });
+	std::vector<User> users;
+	for (int i = 0; i < 1000; ++i)
+		users.emplace_back(i, "user" + std::to_string(i), i * 0.5);
+	MergeResult first = upsert.merge(users);
+	CHECK(first.inserted == 1000 && first.updated == 0 && first.unchanged == 0);
+
+	for (int i = 0; i < 1000; i += 4)
+		std::get<1>(users[i]) += "!";
+	for (int i = 1000; i < 1100; ++i)
+		users.emplace_back(i, "user" + std::to_string(i), i * 0.5);
+	MergeResult second = upsert.merge(users);
+	CHECK(second.inserted == 100);
+	CHECK(second.updated == 250);
+	CHECK(second.unchanged == 750);
+	CHECK(!db.inTransaction());
+	CHECK(db.executeQuery("SELECT count(*) c FROM U WHERE name LIKE '%!'").get<int>("c") == 250);
+}
+
+void testMergeRollsBack()
+{
+	SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER PRIMARY KEY, name TEXT NOT NULL, score REAL)");
+	Upsert<int, const char*, double> upsert(db, "U", { "id", "name", "score" }, { "id" });
+	std::vector<std::tuple<int, const char*, double>> users = { { 1, "a", 1.0 }, { 2, nullptr, 2.0 } };
+	bool thrown = false;
+	try {
+		upsert.merge(users);
+	}
+	catch (const SQLite3Error& e) {
+		thrown = e.code() == SQLITE_CONSTRAINT;
+	}
+	CHECK(thrown);
+	CHECK(!db.inTransaction());
+	CHECK(db.executeQuery("SELECT count(*) c FROM U").get<int>("c") == 0);
+}
+
+//Range whose iterator returns records by value, they have to stay alive until their statement is executed
+class GeneratedUsers
+{
+private:
+	int rows;
+public:
+	class iterator
+	{
+	private:
+		int i;
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef User value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const User* pointer;
+		typedef User reference;
+
+		explicit iterator(int i) : i(i) {}
+		User operator*() const { return User(i, "generated user name " + std::to_string(i), i * 0.25); }
+		iterator& operator++() { ++i; return *this; }
+		bool operator==(const iterator& other) const { return i == other.i; }
+		bool operator!=(const iterator& other) const { return i != other.i; }
+	};
+
+	explicit GeneratedUsers(int rows) : rows(rows) {}
+	iterator begin() const { return iterator(0); }
+	iterator end() const { return iterator(rows); }
+};
+
+void testBulkInsert()
+{
+	std::vector<User> users;
+	for (int i = 0; i < 1234; ++i)
+		users.emplace_back(i, "name" + std::to_string(i), i * 0.5);
+	for (size_t rowsPerStatement : { 1, 7, 100 }) {
+		SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER, name TEXT, score REAL)");
+		BulkInsert<int, std::string, double> insert(db, "U", { "id", "name", "score" }, rowsPerStatement);
+		CHECK(insert(users) == users.size());
+		ResultSet rs = db.executeQuery("SELECT count(*) c, sum(id) s, max(name) m, sum(score) v FROM U");
+		CHECK(rs.get<long>("c") == 1234);
+		CHECK(rs.get<long>("s") == 1234 * 1233 / 2);
+		CHECK(rs.get<std::string>("m") == "name999");
+		CHECK(rs.get<double>("v") == 1234 * 1233 / 4.0);
+		CHECK(!db.inTransaction());
+	}
+
+	SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER, name TEXT, score REAL)");
+	BulkInsert<int, std::string, double> insert(db, "U", { "id", "name", "score" }, 100);
+	CHECK(insert(GeneratedUsers(550)) == 550);
+	CHECK(db.executeQuery("SELECT count(*) c FROM U WHERE name = 'generated user name ' || id").get<int>("c") == 550);
+}
+
+void testBulkInsertInTransaction()
+{
+	SQLite3 db(":memory:", "CREATE TABLE U(id INTEGER, name TEXT, score REAL)");
+	BulkInsert<int, std::string, double> insert(db, "U", { "id", "name", "score" }, 10);
+	std::vector<User> users(25, User(1, "a", 1.0));
+	db.beginTransaction();
+	insert(users);
+	CHECK(db.inTransaction());
+	db.execute("ROLLBACK");
+	CHECK(db.executeQuery("SELECT count(*) c FROM U").get<int>("c") == 0);
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testUpsert);
+	RUN_TEST(testMerge);
+	RUN_TEST(testMergeRollsBack);
+	RUN_TEST(testBulkInsert);
+	RUN_TEST(testBulkInsertInTransaction);
+	return testResult();
+}
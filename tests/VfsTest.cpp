@@ -0,0 +1,321 @@
+#include "MSQLite3Test.h"
+#include "MSQLite3CompressVfs.h"
+#include "MSQLite3UringVfs.h"
+#include "MSQLite3Vfs.h"
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const path = "vfs_test.db";
+
+long count(SQLite3& db)
+{
+	return db.executeQuery("SELECT count(*) c FROM T").get<long>("c");
+}
+
+bool intact(SQLite3& db)
+{
+	return db.executeQuery("PRAGMA integrity_check").get<std::string>("integrity_check") == "ok";
+}
+
+//Writes through one connection and reads through another, rolled back changes must not be visible
+void exercise(const char* vfs, const char* journalMode)
+{
+	TestDatabase file(path);
+	long expected = 0;
+	{
+		SQLite3 writer(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+		writer.execute((std::string("PRAGMA journal_mode=") + journalMode).c_str());
+		SQLite3 reader(path, nullptr, vfs);
+		for (int round = 0; round < 10; ++round) {
+			writer.beginTransaction();
+			for (int i = 0; i < 500; ++i)
+				writer.createPreparedStatement("INSERT INTO T(b) VALUES(?)", std::string(100 + i % 300, 'a' + i % 26)).execute();
+			writer.endTransaction();
+			expected += 500;
+			CHECK(count(reader) == expected);
+		}
+
+		writer.beginTransaction();
+		writer.execute("UPDATE T SET b = 'x'");
+		writer.execute("DELETE FROM T WHERE a % 2 = 0");
+		writer.execute("ROLLBACK");
+		CHECK(count(reader) == expected);
+
+		writer.execute("DELETE FROM T WHERE a % 3 = 0");
+		expected -= expected / 3;
+		reader.execute("PRAGMA cache_size=10");
+		CHECK(count(reader) == expected);
+		CHECK(reader.executeQuery("SELECT count(*) c FROM T WHERE b = 'x'").get<long>("c") == 0);
+		CHECK(intact(reader));
+	}
+	SQLite3 db(path, nullptr, vfs);
+	CHECK(count(db) == expected);
+	CHECK(intact(db));
+}
+
+void testDefaultVfs()
+{
+	exercise(nullptr, "DELETE");
+	exercise(nullptr, "WAL");
+}
+
+void testInstrumentedVfs()
+{
+	const char* vfs = InstrumentedVfs::install();
+	InstrumentedVfs::reset();
+	exercise(vfs, "DELETE");
+	SQLite3Metrics deleteMode;
+	InstrumentedVfs::collect(deleteMode);
+	CHECK(deleteMode.mainDb.writes > 0 && deleteMode.mainDb.bytesWritten > 0);
+	CHECK(deleteMode.journal.writes > 0 && deleteMode.journal.syncs > 0);
+
+	InstrumentedVfs::reset();
+	exercise(vfs, "WAL");
+	SQLite3Metrics walMode;
+	InstrumentedVfs::collect(walMode);
+	CHECK(walMode.wal.writes > 0 && walMode.wal.bytesWritten > 0);
+}
+
+void testCompressedVfs()
+{
+	const char* vfs = CompressedVfs::install();
+	exercise(vfs, "DELETE");
+	exercise(vfs, "WAL");
+
+	TestDatabase file(path);
+	{
+		SQLite3 db(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+		for (int i = 0; i < 2000; ++i)
+			db.createPreparedStatement("INSERT INTO T(b) VALUES(?)", std::string(200, 'a' + i % 26)).execute();
+		db.execute("DELETE FROM T WHERE a % 2 = 0");
+	}
+	CHECK(CompressedVfs::compact(path, 0.99) == 0);
+	CHECK(CompressedVfs::compact(path) > 0);
+	SQLite3 db(path, nullptr, vfs);
+	CHECK(count(db) == 1000);
+	CHECK(intact(db));
+}
+
+//Walks sequences of LZ4 block and checks its end of block rules for input of [size] bytes
+bool followsLz4EndRules(const std::string& block, size_t size)
+{
+	const unsigned char* ip = reinterpret_cast<const unsigned char*>(block.data());
+	const unsigned char* const end = ip + block.size();
+	auto length = [&](size_t value) {
+		unsigned char b;
+		do {
+			b = *ip++;
+			value += b;
+		} while (b == 255);
+		return value;
+	};
+	size_t op = 0;
+	while (ip < end) {
+		const unsigned char token = *ip++;
+		const size_t literals = (token >> 4) == 15 ? length(15) : token >> 4;
+		ip += literals;
+		op += literals;
+		if (ip == end)
+			return op == size && (size < 5 || literals >= 5 || op == literals);
+		ip += 2;
+		const size_t match = ((token & 15) == 15 ? length(15) : token & 15) + 4;
+		if (op + 12 > size || op + match > size - 5)
+			return false;
+		op += match;
+	}
+	return false;
+}
+
+void testLzPageCodec()
+{
+	std::string random(4096, 0);
+	unsigned state = 1;
+	for (char& c : random)
+		c = static_cast<char>((state = state * 1103515245 + 12345) >> 16);
+	std::string text;
+	while (text.size() < 4096)
+		text += "INSERT INTO T VALUES(" + std::to_string(text.size() % 977) + ", 'name');";
+	const std::string inputs[] = {
+		std::string(4096, 'a'), std::string(4096, 0), text, random,
+		std::string(13, 'a'), std::string(12, 'a'), std::string(20, 'a') + "bcdefg", "abcd", ""
+	};
+
+	LzPageCodec codec;
+	for (const std::string& input : inputs) {
+		std::string block;
+		codec.compress(input.data(), input.size(), block);
+		if (block.size() >= input.size() && !input.empty())
+			continue;
+		CHECK(followsLz4EndRules(block, input.size()));
+		std::string output(input.size(), 0);
+		CHECK(codec.decompress(block.data(), block.size(), &output[0], output.size()));
+		CHECK(output == input);
+	}
+}
+
+//Record whose header is written but whose data is not complete yet is not indexed
+void testCompressedVfsIncompleteRecord()
+{
+	const char* vfs = CompressedVfs::install();
+	TestDatabase file(path);
+	{
+		SQLite3 db(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+		for (int i = 0; i < 100; ++i)
+			db.createPreparedStatement("INSERT INTO T(b) VALUES(?)", std::string(200, 'a' + i % 26)).execute();
+	}
+
+	//Appends copy of header of last record of page, followed by zeros instead of its data
+	FILE* f = std::fopen(path, "r+b");
+	std::string content;
+	char chunk[4096];
+	for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), f)) > 0;)
+		content.append(chunk, n);
+	std::string header;
+	uint32_t stored = 0;
+	for (size_t pos = 16; pos + 24 <= content.size();) {
+		uint32_t flags;
+		std::memcpy(&stored, content.data() + pos + 12, 4);
+		std::memcpy(&flags, content.data() + pos + 16, 4);
+		if (flags & 2) {
+			pos += 24;
+			continue;
+		}
+		header = content.substr(pos, 24);
+		pos += 24 + stored + 4;
+	}
+	CHECK(!header.empty());
+	std::fseek(f, 0, SEEK_END);
+	std::fwrite(header.data(), 1, header.size(), f);
+	const std::string zeros(stored + 4, 0);
+	std::fwrite(zeros.data(), 1, zeros.size(), f);
+	std::fclose(f);
+
+	SQLite3 db(path, nullptr, vfs);
+	CHECK(count(db) == 100);
+	CHECK(intact(db));
+	db.execute("INSERT INTO T(b) VALUES('z')");
+	CHECK(count(db) == 101);
+	CHECK(intact(db));
+}
+
+int compactionError(const char* file)
+{
+	try {
+		CompressedVfs::compact(file);
+	}
+	catch (const SQLite3Error& e) {
+		return e.code();
+	}
+	return SQLITE_OK;
+}
+
+void testCompactionRefused()
+{
+	const char* vfs = CompressedVfs::install();
+	TestDatabase file(path);
+	{
+		SQLite3 db(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+		db.execute("INSERT INTO T(b) VALUES('a')");
+		db.execute("UPDATE T SET b = 'b'");
+		CHECK(compactionError(path) == SQLITE_BUSY);
+	}
+
+	//Hot journal left by crash has to be rolled back by SQLite before compaction
+	const std::string journal = std::string(path) + "-journal";
+	FILE* hot = std::fopen(journal.c_str(), "wb");
+	std::fputs("\xd9\xd5\x05\xf9\x20\xa1\x63\xd7", hot);
+	std::fclose(hot);
+	CHECK(compactionError(path) == SQLITE_BUSY);
+	std::remove(journal.c_str());
+
+	CHECK(compactionError(path) == SQLITE_OK);
+	CHECK(compactionError("missing_vfs_test.db") == SQLITE_CANTOPEN);
+}
+
+//Asks child process whether this process holds write lock of RESERVED byte of SQLite
+bool reservedLockHeld(const char* file)
+{
+	const pid_t child = fork();
+	if (child == 0) {
+		const int fd = open(file, O_RDONLY);
+		struct flock lock = {};
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0x40000001;
+		lock.l_len = 1;
+		_exit(fd >= 0 && fcntl(fd, F_GETLK, &lock) == 0 && lock.l_type != F_UNLCK ? 0 : 1);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//Closing of read-only connection must not release locks held by other connections of the process
+void testUringLocksSurviveClose()
+{
+	const char* vfs = UringVfs::install();
+	TestDatabase file(path);
+	SQLite3 writer(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+	writer.execute("INSERT INTO T(b) VALUES('a')");
+	writer.execute("BEGIN IMMEDIATE");
+	writer.execute("INSERT INTO T(b) VALUES('b')");
+	CHECK(reservedLockHeld(path));
+
+	sqlite3* reader = nullptr;
+	CHECK(sqlite3_open_v2(path, &reader, SQLITE_OPEN_READONLY, vfs) == SQLITE_OK);
+	CHECK(sqlite3_exec(reader, "SELECT count(*) FROM T", nullptr, nullptr, nullptr) == SQLITE_OK);
+	sqlite3_close(reader);
+	CHECK(reservedLockHeld(path));
+
+	writer.execute("COMMIT");
+	CHECK(!reservedLockHeld(path));
+	CHECK(count(writer) == 2);
+}
+
+//Connections closed right after short sequential reads leave read ahead in flight, closing has to wait for it
+void testUringCloseDuringReadAhead()
+{
+	const char* vfs = UringVfs::install();
+	TestDatabase file(path);
+	{
+		SQLite3 db(path, "CREATE TABLE T(a INTEGER PRIMARY KEY, b TEXT)", vfs);
+		db.beginTransaction();
+		for (int i = 0; i < 2000; ++i)
+			db.createPreparedStatement("INSERT INTO T(b) VALUES(?)", std::string(500, 'a' + i % 26)).execute();
+		db.endTransaction();
+	}
+	for (int round = 0; round < 50; ++round) {
+		SQLite3 db(path, nullptr, vfs);
+		db.execute("PRAGMA cache_size=5");
+		CHECK(db.executeQuery("SELECT count(*) c FROM (SELECT b FROM T LIMIT 20)").get<int>("c") == 20);
+	}
+}
+
+void testUringVfs()
+{
+	const char* vfs = UringVfs::install();
+	std::printf("io_uring %s\n", UringVfs::isAvailable() ? "available" : "not available, default VFS is tested");
+	exercise(vfs, "DELETE");
+	exercise(vfs, "WAL");
+}
+
+}
+
+int main()
+{
+	RUN_TEST(testDefaultVfs);
+	RUN_TEST(testInstrumentedVfs);
+	RUN_TEST(testCompressedVfs);
+	RUN_TEST(testLzPageCodec);
+	RUN_TEST(testCompressedVfsIncompleteRecord);
+	RUN_TEST(testCompactionRefused);
+	RUN_TEST(testUringVfs);
+	RUN_TEST(testUringLocksSurviveClose);
+	RUN_TEST(testUringCloseDuringReadAhead);
+	return testResult();
+}
@@ -0,0 +1,11 @@
+#include "MSQLite3.h"
+
+//Does not compile, statement of query with two parameters is bound with one argument
+//Built by test QueryArityRejected, which expects message of static_assert in output of compiler
+int main()
+{
+	SQLite3 db(":memory:", "CREATE TABLE User(id INTEGER, name TEXT)");
+	auto insert = db.createPreparedStatement(MSQLITE3_QUERY("INSERT INTO User(id, name) VALUES(?, ?)"));
+	insert.bind(1);
+	return 0;
+}
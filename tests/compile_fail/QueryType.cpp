@@ -0,0 +1,12 @@
+#include "MSQLite3.h"
+#include <string>
+
+//Does not compile, argument does not convert to declared type of parameter
+//Built by test QueryTypeRejected, which expects message of static_assert in output of compiler
+int main()
+{
+	SQLite3 db(":memory:", "CREATE TABLE User(id INTEGER, name TEXT)");
+	auto insert = db.createPreparedStatement(MSQLITE3_TYPED_QUERY("INSERT INTO User(id, name) VALUES(?, ?)", int, std::string));
+	insert.bind(1, 2.5);
+	return 0;
+}